@@ -0,0 +1,198 @@
+#include "arena.hpp"
+#include "engine.hpp"
+#include "mcts.hpp"
+#include "perfect_play.hpp"
+#include "thread_pool.hpp"
+#include "tree_search.hpp"
+#include "util.hpp"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace tic_tac_toe {
+namespace arena {
+    // the perfect play table that judges every move only exists for tic-tac-toe
+    using Rules = engine::TicTacToe;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr U64 seed = 420;
+
+    enum class Kind : U8 {
+        Random,
+        TreeSearch, // alpha-beta, it plays perfectly and keeps no state, so games can run on every thread at once
+        Mcts
+    };
+
+    struct Player {
+        const char* name;
+        Kind kind;
+        mcts::Config config; // only for Kind::Mcts, always one thread as the games already run in parallel
+    };
+
+    // the moves of one side of a match
+    struct MoveStats {
+        U64 move_count;
+        U64 optimal_move_count; // moves the perfect play table also plays
+        double seconds;
+        double max_seconds;
+        U64 used_bytes; // summed over the moves, of the search after each move
+        U64 max_used_bytes;
+        U64 max_allocated_bytes;
+    };
+
+    enum class Outcome : U8 {
+        Win,
+        Draw,
+        Loss
+    };
+
+    struct MatchStats {
+        U64 counts[3]; // indexed by Outcome
+        MoveStats moves;
+    };
+
+    static void add(MoveStats& stats, const MoveStats& other) {
+        stats.move_count += other.move_count;
+        stats.optimal_move_count += other.optimal_move_count;
+        stats.seconds += other.seconds;
+        stats.max_seconds = other.max_seconds > stats.max_seconds ? other.max_seconds : stats.max_seconds;
+        stats.used_bytes += other.used_bytes;
+        stats.max_used_bytes = other.max_used_bytes > stats.max_used_bytes ? other.max_used_bytes : stats.max_used_bytes;
+        stats.max_allocated_bytes = other.max_allocated_bytes > stats.max_allocated_bytes ? other.max_allocated_bytes : stats.max_allocated_bytes;
+    }
+
+    // plays the move of player, every equally good move of a search is as likely as the others
+    static void play_move(const Player& player, mcts::Search<Rules>& search, engine::Board<Rules>& board, util::Rng& rng) {
+        switch (player.kind) {
+            case Kind::Random:
+                engine::play_move(board, engine::get_coordinate<Rules>(engine::get_random_move(board.state, rng)));
+                return;
+            case Kind::TreeSearch:
+                tree_search::generate_computer_moves<tree_search::Mode::AlphaBeta>(board);
+                break;
+            case Kind::Mcts:
+                mcts::generate_computer_moves(search, board, rng, player.config);
+                break;
+        }
+        engine::play_computer_move(board, rng);
+    }
+
+    // every side keeps its search for the whole game, as the ui does, so mcts reuses its tree between moves
+    // only the moves of player are measured
+    static Outcome play_game(const Player& player, const Player& opponent, engine::Player player_side, util::Rng& rng, MoveStats& stats) {
+        engine::Board<Rules> board{};
+        mcts::Search<Rules> searches[2]; // indexed by engine::Player
+        while (board.state.game_end == engine::GameEnd::None) {
+            const engine::Player side = board.state.next_turn;
+            mcts::Search<Rules>& search = searches[static_cast<U8>(side)];
+            if (side != player_side) {
+                play_move(opponent, search, board, rng);
+                continue;
+            }
+
+            const Rules::Mask optimal_moves = perfect_play::get_best_moves(board.state);
+            const Clock::time_point start = Clock::now();
+            play_move(player, search, board, rng);
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            const mcts::MemoryUsage memory = mcts::get_memory_usage(search);
+
+            const engine::Coordinate move = board.history[board.state.ply - 1];
+            add(stats, MoveStats{
+                1,
+                engine::has_cell(optimal_moves, engine::index<Rules>(move)) ? 1u : 0u,
+                seconds,
+                seconds,
+                memory.used_bytes,
+                memory.used_bytes,
+                memory.allocated_bytes
+            });
+        }
+
+        if (board.state.game_end == engine::GameEnd::Draw) {
+            return Outcome::Draw;
+        }
+        const engine::GameEnd player_win = player_side == engine::Player::O ? engine::GameEnd::OWin : engine::GameEnd::XWin;
+        return board.state.game_end == player_win ? Outcome::Win : Outcome::Loss;
+    }
+
+    // player moves first in every other game
+    // every game has its own seed and the results are added up in game order, so they do not depend on the thread count,
+    // only the times do
+    static MatchStats play_match(thread_pool::ThreadPool& pool, const Player& player, const Player& opponent, U32 match_index, U32 game_count) {
+        std::vector<Outcome> outcomes(game_count);
+        std::vector<MoveStats> moves(game_count);
+        thread_pool::run(pool, game_count, [&](U32 game) {
+            util::Rng rng = util::make_rng(seed + (static_cast<U64>(match_index) << 32) + game);
+            const engine::Player player_side = game % 2 == 0 ? engine::Player::O : engine::Player::X;
+            moves[game] = MoveStats{};
+            outcomes[game] = play_game(player, opponent, player_side, rng, moves[game]);
+        });
+
+        MatchStats result{};
+        for (U32 game = 0; game < game_count; ++game) {
+            ++result.counts[static_cast<U8>(outcomes[game])];
+            add(result.moves, moves[game]);
+        }
+        return result;
+    }
+
+    static double get_rate(U64 count, U64 total) {
+        return total > 0 ? static_cast<double>(count) / static_cast<double>(total) : 0.0;
+    }
+
+    static Player make_mcts_player(const char* name, U32 max_iterations, bool rave = false) {
+        Player result{name, Kind::Mcts, mcts::Config{}};
+        result.config.max_iterations = max_iterations;
+        result.config.rave = rave;
+        return result;
+    }
+
+    int run(U32 game_count) {
+        const Player random{"random", Kind::Random, mcts::Config{}};
+        const Player perfect{"tree_search", Kind::TreeSearch, mcts::Config{}};
+        const Player players[] = {
+            random,
+            perfect,
+            make_mcts_player("mcts_10", 10),
+            make_mcts_player("mcts_100", 100),
+            make_mcts_player("mcts_1000", 1000),
+            make_mcts_player("mcts_10000", 10 * 1000),
+            make_mcts_player("mcts_100000", 100 * 1000),
+            make_mcts_player("mcts_rave_100", 100, true),
+            make_mcts_player("mcts_rave_1000", 1000, true),
+        };
+        const Player* opponents[] = {&random, &perfect};
+
+        thread_pool::ThreadPool pool(thread_pool::hardware_thread_count());
+        std::printf("{\n  \"seed\": %llu,\n  \"threads\": %u,\n  \"games_per_match\": %u,\n  \"matches\": [", seed, thread_pool::thread_count(pool), game_count);
+
+        U32 match_index = 0;
+        for (const Player& player : players) {
+            for (const Player* opponent : opponents) {
+                const MatchStats stats = play_match(pool, player, *opponent, match_index, game_count);
+                const MoveStats& moves = stats.moves;
+                const U64 wins = stats.counts[static_cast<U8>(Outcome::Win)];
+                const U64 draws = stats.counts[static_cast<U8>(Outcome::Draw)];
+                const U64 losses = stats.counts[static_cast<U8>(Outcome::Loss)];
+
+                std::printf(match_index == 0 ? "\n    {" : ",\n    {");
+                std::printf("\"player\": \"%s\", \"opponent\": \"%s\", \"max_iterations\": %u, \"rave\": %s, \"games\": %u",
+                    player.name, opponent->name, player.kind == Kind::Mcts ? player.config.max_iterations : 0, player.config.rave ? "true" : "false", game_count);
+                std::printf(", \"wins\": %llu, \"draws\": %llu, \"losses\": %llu, \"win_rate\": %.4f, \"draw_rate\": %.4f, \"loss_rate\": %.4f",
+                    wins, draws, losses, get_rate(wins, game_count), get_rate(draws, game_count), get_rate(losses, game_count));
+                std::printf(", \"moves\": %llu, \"optimal_move_rate\": %.4f, \"mean_move_ms\": %.4f, \"max_move_ms\": %.4f",
+                    moves.move_count, get_rate(moves.optimal_move_count, moves.move_count),
+                    moves.move_count > 0 ? moves.seconds * 1000.0 / static_cast<double>(moves.move_count) : 0.0, moves.max_seconds * 1000.0);
+                std::printf(", \"mean_memory_bytes\": %.0f, \"max_memory_bytes\": %llu, \"max_allocated_bytes\": %llu}",
+                    moves.move_count > 0 ? static_cast<double>(moves.used_bytes) / static_cast<double>(moves.move_count) : 0.0,
+                    moves.max_used_bytes, moves.max_allocated_bytes);
+                std::fflush(stdout);
+                ++match_index;
+            }
+        }
+
+        std::printf("\n  ]\n}\n");
+        return 0;
+    }
+} // namespace arena
+} // namespace tic_tac_toe
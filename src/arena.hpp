@@ -0,0 +1,11 @@
+#pragma once
+
+#include "util.hpp"
+
+namespace tic_tac_toe {
+namespace arena {
+    // plays every configuration against a random and a perfect opponent, game_count games a match on every hardware thread,
+    // and prints the results to stdout as one json object
+    int run(U32 game_count);
+} // namespace arena
+} // namespace tic_tac_toe
@@ -0,0 +1,18 @@
+#include "engine.cpp"
+#include "thread_pool.cpp"
+#include "rollout.cpp"
+#include "mcts.cpp"
+#include "perfect_play.cpp"
+#include "tree_search.cpp"
+#include "arena.cpp"
+#include <cstdlib>
+
+// mcts_arena [games per match]
+int main(int argc, char** argv) {
+    const unsigned long game_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    if (game_count == 0 || game_count > 0xFFFFFFFF) {
+        std::fprintf(stderr, "usage: %s [games per match]\n", argv[0]);
+        return 1;
+    }
+    return tic_tac_toe::arena::run(static_cast<tic_tac_toe::U32>(game_count));
+}
@@ -0,0 +1,302 @@
+#include "bench.hpp"
+#include "engine.hpp"
+#include "mcts.hpp"
+#include "rollout.hpp"
+#include "thread_pool.hpp"
+#include "tree_search.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace tic_tac_toe {
+namespace bench {
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr U64 seed = 420;
+
+    static double get_seconds_since(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    static double per_second(U64 count, double seconds) {
+        return seconds > 0.0 ? static_cast<double>(count) / seconds : 0.0;
+    }
+
+    // results are printed as they are measured, every one after the first of its array needs a comma before it
+    static void begin_result(bool& first) {
+        std::printf(first ? "\n    {" : ",\n    {");
+        first = false;
+    }
+
+    template <typename Rules>
+    static void print_rules() {
+        std::printf("\"width\": %u, \"height\": %u, \"win_length\": %u", static_cast<U32>(Rules::width), static_cast<U32>(Rules::height), static_cast<U32>(Rules::win_length));
+    }
+
+    // how the games ended, printed with every result so a change that breaks the engine shows up as well as a slow one
+    struct Outcomes {
+        U64 counts[4]; // indexed by engine::GameEnd
+    };
+
+    static void print_outcomes(const Outcomes& outcomes) {
+        std::printf(", \"o_wins\": %llu, \"x_wins\": %llu, \"draws\": %llu",
+            outcomes.counts[static_cast<U8>(engine::GameEnd::OWin)],
+            outcomes.counts[static_cast<U8>(engine::GameEnd::XWin)],
+            outcomes.counts[static_cast<U8>(engine::GameEnd::Draw)]);
+    }
+
+    // games of random moves stopped at a ply between min_ply and max_ply, every one still running
+    template <typename Rules>
+    static std::vector<engine::Board<Rules>> get_positions(U32 count, U32 min_ply, U32 max_ply, util::Rng& rng) {
+        std::vector<engine::Board<Rules>> result;
+        while (result.size() < count) {
+            engine::Board<Rules> board{};
+            const U32 ply = min_ply + util::random_below(rng, max_ply - min_ply + 1);
+            while (board.state.ply < ply && board.state.game_end == engine::GameEnd::None) {
+                engine::play_move(board, engine::get_coordinate<Rules>(engine::get_random_move(board.state, rng)));
+            }
+            if (board.state.game_end == engine::GameEnd::None) {
+                result.push_back(board);
+            }
+        }
+        return result;
+    }
+
+    // random games from the empty board, one at a time through mcts::simulate and in simd batches through the
+    // rollout::simulate_batch mcts calls for them, so the numbers follow whatever the search itself plays
+    // bench_main builds the searches into the same translation unit, so the file local simulate can be called
+    template <typename Rules>
+    static void bench_rollouts(U32 game_count, bool& first) {
+        const engine::SearchState<Rules> start{};
+
+        {
+            util::Rng rng = util::make_rng(seed);
+            Outcomes outcomes{};
+            const Clock::time_point start_time = Clock::now();
+            for (U32 i = 0; i < game_count; ++i) {
+                engine::SearchState<Rules> state = start;
+                ++outcomes.counts[static_cast<U8>(mcts::simulate(state, rng))];
+            }
+            const double seconds = get_seconds_since(start_time);
+
+            begin_result(first);
+            print_rules<Rules>();
+            std::printf(", \"batch_size\": 1, \"games\": %u, \"seconds\": %.6f, \"rollouts_per_second\": %.0f", game_count, seconds, per_second(game_count, seconds));
+            print_outcomes(outcomes);
+            std::printf("}");
+        }
+
+        {
+            util::Rng rng = util::make_rng(seed);
+            rollout::BatchRng batch_rng = rollout::make_batch_rng(rng);
+            engine::GameEnd results[rollout::max_batch_size];
+            Outcomes outcomes{};
+            const U32 batch_count = game_count / rollout::max_batch_size;
+            const Clock::time_point start_time = Clock::now();
+            for (U32 i = 0; i < batch_count; ++i) {
+                rollout::simulate_batch(start, rollout::max_batch_size, batch_rng, results);
+                for (const engine::GameEnd result : results) {
+                    ++outcomes.counts[static_cast<U8>(result)];
+                }
+            }
+            const double seconds = get_seconds_since(start_time);
+            const U32 played_count = batch_count * rollout::max_batch_size;
+
+            begin_result(first);
+            print_rules<Rules>();
+            std::printf(", \"batch_size\": %u, \"games\": %u, \"seconds\": %.6f, \"rollouts_per_second\": %.0f", rollout::max_batch_size, played_count, seconds, per_second(played_count, seconds));
+            print_outcomes(outcomes);
+            std::printf("}");
+        }
+    }
+
+    // replays recorded random games, so the time is spent in play_move and detect_win rather than in picking moves
+    template <typename Rules>
+    static void bench_play_move(U32 game_count, U32 pass_count, bool& first) {
+        util::Rng rng = util::make_rng(seed);
+        std::vector<engine::CellIndex> moves;
+        std::vector<U32> game_ends; // one past the last move of every game
+        for (U32 i = 0; i < game_count; ++i) {
+            engine::SearchState<Rules> state{};
+            while (state.game_end == engine::GameEnd::None) {
+                const engine::CellIndex move = engine::get_random_move(state, rng);
+                engine::play_move(state, move);
+                moves.push_back(move);
+            }
+            game_ends.push_back(static_cast<U32>(moves.size()));
+        }
+
+        Outcomes outcomes{};
+        const Clock::time_point start_time = Clock::now();
+        for (U32 pass = 0; pass < pass_count; ++pass) {
+            U32 move = 0;
+            for (const U32 game_end : game_ends) {
+                engine::SearchState<Rules> state{};
+                for (; move < game_end; ++move) {
+                    engine::play_move(state, moves[move]);
+                }
+                ++outcomes.counts[static_cast<U8>(state.game_end)];
+            }
+        }
+        const double seconds = get_seconds_since(start_time);
+        const U64 move_count = static_cast<U64>(moves.size()) * pass_count;
+
+        begin_result(first);
+        print_rules<Rules>();
+        std::printf(", \"games\": %llu, \"moves\": %llu, \"seconds\": %.6f, \"moves_per_second\": %.0f",
+            static_cast<U64>(game_count) * pass_count, move_count, seconds, per_second(move_count, seconds));
+        print_outcomes(outcomes);
+        std::printf("}");
+    }
+
+    static const char* get_name(tree_search::Mode mode) {
+        switch (mode) {
+            case tree_search::Mode::Memoized:
+                return "memoized";
+            case tree_search::Mode::AlphaBeta:
+                return "alpha_beta";
+            case tree_search::Mode::Table:
+                return "table";
+        }
+        return "";
+    }
+
+    // one timed pass of a tree search mode over every position
+    template <tree_search::Mode mode, typename Rules>
+    static void bench_tree_search_pass(const std::vector<engine::Board<Rules>>& positions, const char* cache, bool& first) {
+        U64 node_count = 0;
+        U64 move_count = 0;
+        const Clock::time_point start_time = Clock::now();
+        for (const engine::Board<Rules>& position : positions) {
+            engine::Board<Rules> board = position;
+            node_count += tree_search::generate_computer_moves<mode>(board);
+            move_count += board.ai_best_moves_count;
+        }
+        const double seconds = get_seconds_since(start_time);
+
+        begin_result(first);
+        print_rules<Rules>();
+        std::printf(", \"mode\": \"%s\", \"cache\": \"%s\", \"positions\": %u, \"nodes\": %llu, \"best_moves\": %llu, \"seconds\": %.6f, \"nodes_per_second\": %.0f}",
+            get_name(mode), cache, static_cast<U32>(positions.size()), node_count, move_count, seconds, per_second(node_count, seconds));
+    }
+
+    // only tic-tac-toe can be solved exhaustively
+    // the memoized cache lives as long as the program, so its first pass is timed on its own as the cold one
+    static void bench_tree_search(U32 position_count, bool& first) {
+        using Rules = engine::TicTacToe;
+        util::Rng rng = util::make_rng(seed);
+        const std::vector<engine::Board<Rules>> positions = get_positions<Rules>(position_count, 0, Rules::cell_count - 1, rng);
+
+        bench_tree_search_pass<tree_search::Mode::AlphaBeta>(positions, "none", first);
+        bench_tree_search_pass<tree_search::Mode::Memoized>(positions, "cold", first);
+        bench_tree_search_pass<tree_search::Mode::Memoized>(positions, "warm", first);
+    }
+
+    // nearest rank, values must be sorted
+    static double get_percentile(const std::vector<double>& values, U32 percent) {
+        const size_t rank = (values.size() * percent + 99) / 100;
+        return values[rank > 0 ? rank - 1 : 0];
+    }
+
+    // searches from scratch on fixed positions, every one with its own fixed seed
+    // one Search runs every sample, as the ui keeps one, so its threads are started once by an untimed search
+    // and only the tree is dropped between samples
+    template <typename Rules>
+    static void bench_search_latency(U32 sample_count, U32 max_ply, const mcts::Config& config, bool& first) {
+        util::Rng rng = util::make_rng(seed);
+        const std::vector<engine::Board<Rules>> positions = get_positions<Rules>(sample_count, 0, max_ply, rng);
+
+        mcts::Search<Rules> search;
+        {
+            engine::Board<Rules> board = positions[0];
+            util::Rng search_rng = util::make_rng(seed);
+            mcts::generate_computer_moves(search, board, search_rng, config);
+        }
+
+        std::vector<double> milliseconds;
+        for (U32 i = 0; i < sample_count; ++i) {
+            engine::Board<Rules> board = positions[i];
+            util::Rng search_rng = util::make_rng(seed + i);
+            search.trees.clear();
+            const Clock::time_point start_time = Clock::now();
+            mcts::generate_computer_moves(search, board, search_rng, config);
+            milliseconds.push_back(get_seconds_since(start_time) * 1000.0);
+        }
+        std::sort(milliseconds.begin(), milliseconds.end());
+
+        double total = 0.0;
+        for (const double value : milliseconds) {
+            total += value;
+        }
+
+        begin_result(first);
+        print_rules<Rules>();
+        std::printf(", \"threads\": %u, \"parallelism\": \"%s\", \"rollouts_per_leaf\": %u, \"max_iterations\": %u, \"searches\": %u",
+            config.thread_count, config.parallelism == mcts::Parallelism::Tree ? "tree" : "root", config.rollouts_per_leaf, config.max_iterations, sample_count);
+        std::printf(", \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f}",
+            total / sample_count, get_percentile(milliseconds, 50), get_percentile(milliseconds, 90), get_percentile(milliseconds, 99), milliseconds.back());
+    }
+
+    template <typename Rules>
+    static void bench_search_latency(U32 sample_count, U32 max_ply, U32 max_iterations, bool& first) {
+        mcts::Config config;
+        config.max_iterations = max_iterations;
+        bench_search_latency<Rules>(sample_count, max_ply, config, first);
+
+        // every hardware thread on one shared tree, the timing is no longer exactly repeatable but the moves stay close
+        config.thread_count = thread_pool::hardware_thread_count();
+        config.parallelism = mcts::Parallelism::Tree;
+        if (config.thread_count > 1) {
+            bench_search_latency<Rules>(sample_count, max_ply, config, first);
+        }
+    }
+
+    int run(bool smoke) {
+        const auto scale = [smoke](U32 count) {
+            return smoke ? util::max(count >> 6, 1) : count;
+        };
+
+        std::printf("{\n  \"seed\": %llu,\n  \"smoke\": %s,\n  \"avx2\": %s,\n  \"asserts\": %s,", seed, smoke ? "true" : "false",
+#if defined(__AVX2__)
+            "true",
+#else
+            "false",
+#endif
+#if defined(NDEBUG)
+            "false"
+#else
+            "true"
+#endif
+        );
+
+        bool first = true;
+        std::printf("\n  \"rollouts\": [");
+        bench_rollouts<engine::TicTacToe>(scale(1 << 21), first);
+        bench_rollouts<engine::ConnectFive>(scale(1 << 17), first);
+        bench_rollouts<engine::Gomoku>(scale(1 << 14), first);
+        std::printf("\n  ],");
+
+        first = true;
+        std::printf("\n  \"play_move\": [");
+        bench_play_move<engine::TicTacToe>(scale(1 << 16), 32, first);
+        bench_play_move<engine::ConnectFive>(scale(1 << 14), 8, first);
+        bench_play_move<engine::Gomoku>(scale(1 << 12), 4, first);
+        std::printf("\n  ],");
+
+        first = true;
+        std::printf("\n  \"tree_search\": [");
+        bench_tree_search(scale(1 << 10), first);
+        std::printf("\n  ],");
+
+        first = true;
+        std::printf("\n  \"generate_computer_moves\": [");
+        bench_search_latency<engine::TicTacToe>(scale(64), 6, scale(100 * 1000), first);
+        bench_search_latency<engine::ConnectFive>(scale(16), 12, scale(10 * 1000), first);
+        bench_search_latency<engine::Gomoku>(scale(8), 20, scale(5 * 1000), first);
+        std::printf("\n  ]\n}\n");
+        return 0;
+    }
+} // namespace bench
+} // namespace tic_tac_toe
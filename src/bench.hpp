@@ -0,0 +1,9 @@
+#pragma once
+
+namespace tic_tac_toe {
+namespace bench {
+    // runs every benchmark with fixed seeds and prints the results to stdout as one json object
+    // smoke runs each on a 64th of its work, to check they all still run rather than to time them
+    int run(bool smoke);
+} // namespace bench
+} // namespace tic_tac_toe
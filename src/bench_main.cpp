@@ -0,0 +1,19 @@
+#include "engine.cpp"
+#include "thread_pool.cpp"
+#include "rollout.cpp"
+#include "mcts.cpp"
+#include "perfect_play.cpp"
+#include "tree_search.cpp"
+#include "bench.cpp"
+#include <cstdio>
+#include <cstring>
+
+// mcts_bench [--smoke]
+int main(int argc, char** argv) {
+    const bool smoke = argc == 2 && std::strcmp(argv[1], "--smoke") == 0;
+    if (argc > 2 || (argc == 2 && !smoke)) {
+        std::fprintf(stderr, "usage: %s [--smoke]\n", argv[0]);
+        return 1;
+    }
+    return tic_tac_toe::bench::run(smoke);
+}
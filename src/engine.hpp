@@ -1,4 +1,3 @@
-
 #pragma once
 
 #include "util.hpp"
@@ -6,22 +5,24 @@
 #include <cmath>
 #include <cstring>
 #include <cstdio>
+#include <bit>
+#include <type_traits>
 
 
 namespace tic_tac_toe {
 namespace engine {
-    enum class Player {
+    enum class Player : U8 {
         O,
         X
     };
 
-    enum class Cell {
+    enum class Cell : U8 {
         Empty,
         O,
         X
     };
 
-    enum class GameEnd {
+    enum class GameEnd : U8 {
         None,
         Draw,
         OWin,
@@ -32,40 +33,483 @@ namespace engine {
         using Type = U8;
         Coordinate();
         Coordinate(Type row, Type col);
-        Coordinate(Type i);
 
         Type r;
         Type c;
     };
 
-    struct Board {
+    // cells are numbered row by row
+    using CellIndex = U16;
+
+    // a mask of a board with more than 64 cells, spread over several words
+    template <U32 WordCount>
+    struct WideMask {
+        U64 words[WordCount];
+
+        constexpr explicit operator bool() const {
+            for (const U64 word : words) {
+                if (word) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        constexpr WideMask& operator&=(const WideMask& other) {
+            for (U32 i = 0; i < WordCount; ++i) {
+                words[i] &= other.words[i];
+            }
+            return *this;
+        }
+
+        constexpr WideMask& operator|=(const WideMask& other) {
+            for (U32 i = 0; i < WordCount; ++i) {
+                words[i] |= other.words[i];
+            }
+            return *this;
+        }
+
+        constexpr WideMask& operator^=(const WideMask& other) {
+            for (U32 i = 0; i < WordCount; ++i) {
+                words[i] ^= other.words[i];
+            }
+            return *this;
+        }
+
+        friend constexpr WideMask operator&(WideMask a, const WideMask& b) {
+            return a &= b;
+        }
+
+        friend constexpr WideMask operator|(WideMask a, const WideMask& b) {
+            return a |= b;
+        }
+
+        friend constexpr WideMask operator^(WideMask a, const WideMask& b) {
+            return a ^= b;
+        }
+
+        friend constexpr WideMask operator~(WideMask a) {
+            for (U64& word : a.words) {
+                word = ~word;
+            }
+            return a;
+        }
+
+        friend constexpr bool operator==(const WideMask& a, const WideMask& b) = default;
+    };
+
+    // one bit per cell, bit i is the cell with index i
+    // the smallest unsigned type that fits the board, so 3x3 masks stay 16 bits
+    template <U32 CellCount>
+    using MaskOf = std::conditional_t<CellCount <= 16, U16,
+        std::conditional_t<CellCount <= 32, U32,
+        std::conditional_t<CellCount <= 64, U64, WideMask<(CellCount + 63) / 64>>>>;
+
+    // the same operations for plain and wide masks, so the search code does not care which one it has
+
+    template <typename Mask>
+    constexpr Mask get_cell_mask(CellIndex cell) {
+        if constexpr (std::is_integral_v<Mask>) {
+            return static_cast<Mask>(Mask(1) << cell);
+        } else {
+            Mask result{};
+            result.words[cell / 64] = U64(1) << (cell % 64);
+            return result;
+        }
+    }
+
+    template <typename Mask>
+    constexpr bool has_cell(const Mask& mask, CellIndex cell) {
+        if constexpr (std::is_integral_v<Mask>) {
+            return (mask >> cell) & 1;
+        } else {
+            return (mask.words[cell / 64] >> (cell % 64)) & 1;
+        }
+    }
+
+    template <typename Mask>
+    constexpr U32 count_cells(const Mask& mask) {
+        if constexpr (std::is_integral_v<Mask>) {
+            return static_cast<U32>(std::popcount(mask));
+        } else {
+            U32 result = 0;
+            for (const U64 word : mask.words) {
+                result += static_cast<U32>(std::popcount(word));
+            }
+            return result;
+        }
+    }
+
+    // the mask must not be empty
+    template <typename Mask>
+    constexpr CellIndex get_first_cell(const Mask& mask) {
+        if constexpr (std::is_integral_v<Mask>) {
+            assert(mask != 0);
+            return static_cast<CellIndex>(std::countr_zero(mask));
+        } else {
+            U32 i = 0;
+            while (mask.words[i] == 0) {
+                ++i;
+            }
+            return static_cast<CellIndex>(i * 64 + std::countr_zero(mask.words[i]));
+        }
+    }
+
+    template <typename Mask>
+    constexpr Mask without_first_cell(Mask mask) {
+        if constexpr (std::is_integral_v<Mask>) {
+            return static_cast<Mask>(mask & (mask - 1));
+        } else {
+            for (U64& word : mask.words) {
+                if (word) {
+                    word &= word - 1;
+                    break;
+                }
+            }
+            return mask;
+        }
+    }
+
+    // n counts from 0 and must be below count_cells(mask)
+    template <typename Mask>
+    CellIndex get_nth_cell(Mask mask, U32 n) {
+        if constexpr (!std::is_integral_v<Mask>) {
+            U32 first = 0;
+            for (const U64 word : mask.words) {
+                const U32 count = static_cast<U32>(std::popcount(word));
+                if (n < count) {
+                    return static_cast<CellIndex>(first + get_nth_cell(word, n));
+                }
+                n -= count;
+                first += 64;
+            }
+            assert(false);
+            return 0;
+        } else {
+            for (U32 i = 0; i < n; ++i) {
+                mask &= mask - 1;
+            }
+            return get_first_cell(mask);
+        }
+    }
+
+    // board dimensions and how many in a row win, everything else in the engine is parameterised on it
+    template <U8 Width, U8 Height, U8 WinLength>
+    struct Rules {
+        static_assert(Width > 0 && Height > 0 && WinLength > 0);
+        static_assert(WinLength <= Width || WinLength <= Height);
+        static constexpr U8 width = Width;
+        static constexpr U8 height = Height;
+        static constexpr U8 win_length = WinLength;
+        static constexpr CellIndex cell_count = Width * Height;
+        using Mask = MaskOf<cell_count>;
+        using Ply = std::conditional_t<cell_count < 256, U8, U16>;
+    };
+
+    using TicTacToe = Rules<3, 3, 3>;
+    using ConnectFive = Rules<7, 7, 5>;
+    using Gomoku = Rules<15, 15, 5>;
+
+    template <typename Rules>
+    constexpr typename Rules::Mask full_mask = [] {
+        typename Rules::Mask result{};
+        for (CellIndex i = 0; i < Rules::cell_count; ++i) {
+            result |= get_cell_mask<typename Rules::Mask>(i);
+        }
+        return result;
+    }();
+
+    // rows, columns, then both diagonals
+    template <typename Rules>
+    constexpr U32 win_line_count =
+        (Rules::win_length <= Rules::width ? Rules::height * (Rules::width - Rules::win_length + 1) : 0)
+        + (Rules::win_length <= Rules::height ? Rules::width * (Rules::height - Rules::win_length + 1) : 0)
+        + (Rules::win_length <= Rules::width && Rules::win_length <= Rules::height
+            ? 2 * (Rules::width - Rules::win_length + 1) * (Rules::height - Rules::win_length + 1) : 0);
+
+    template <typename Rules>
+    struct WinLines {
+        typename Rules::Mask lines[win_line_count<Rules>];
+    };
+
+    // every run of win_length cells in a row, column or diagonal as a cell mask
+    template <typename Rules>
+    constexpr WinLines<Rules> win_lines = [] {
+        using Mask = typename Rules::Mask;
+        constexpr int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        WinLines<Rules> result{};
+        U32 count = 0;
+        for (const auto& direction : directions) {
+            for (int r = 0; r < Rules::height; ++r) {
+                for (int c = 0; c < Rules::width; ++c) {
+                    const int last_r = r + direction[0] * (Rules::win_length - 1);
+                    const int last_c = c + direction[1] * (Rules::win_length - 1);
+                    if (last_r < 0 || last_r >= Rules::height || last_c < 0 || last_c >= Rules::width) {
+                        continue;
+                    }
+
+                    Mask line{};
+                    for (int i = 0; i < Rules::win_length; ++i) {
+                        line |= get_cell_mask<Mask>(static_cast<CellIndex>((r + direction[0] * i) * Rules::width + c + direction[1] * i));
+                    }
+                    result.lines[count] = line;
+                    ++count;
+                }
+            }
+        }
+        return result;
+    }();
+
+    // everything the search engines need to play out a game, cheap to copy
+    template <typename Rules>
+    struct SearchState {
+        typename Rules::Mask cells[2]; // indexed by Player
         Player next_turn;
-        Cell cell[3][3];
+        typename Rules::Ply ply;
         GameEnd game_end;
-        U8 history_next_index;
-        U8 history_count;
-        Coordinate history[9];
-        Coordinate win_cell[6];
-        U8 win_cell_count;
-        Coordinate ai_best_moves[9];
-        U8 ai_best_moves_count;
+    };
+    static_assert(std::is_trivially_copyable_v<SearchState<TicTacToe>>);
+
+    // a SearchState plus the history and suggestions used by the ui
+    template <typename Rules>
+    struct Board {
+        SearchState<Rules> state;
+        typename Rules::Ply history_count;
+        Coordinate history[Rules::cell_count];
+        Coordinate ai_best_moves[Rules::cell_count];
+        CellIndex ai_best_moves_count;
     };
 
     Cell get_cell(Player player);
-    Player other(Player p); 
-    Coordinate::Type index(Coordinate coord);
-    Cell get_cell(const Board& board, Coordinate coord);
-    Cell& get_cell(Board& board, Coordinate coord);
-    void set_cell(Board& board, Coordinate coord, Player p);
-    void detect_win(Board& board);
-    void play_move(Board& board, Coordinate coord, bool is_redo = false);
+    Player other(Player p);
     bool is_valid(Coordinate coord);
     Coordinate invalid_coordinate();
-    bool can_undo(const Board& board);
-    bool can_redo(const Board& board);
-    bool undo(Board& board);
-    bool redo(Board& board);
-    void play_computer_move(Board& board);
-    Coordinate get_random_move(const Board& board);
+
+    template <typename Rules>
+    CellIndex index(Coordinate coord) {
+        return static_cast<CellIndex>(coord.c + coord.r * Rules::width);
+    }
+
+    template <typename Rules>
+    Coordinate get_coordinate(CellIndex cell) {
+        return Coordinate(static_cast<Coordinate::Type>(cell / Rules::width), static_cast<Coordinate::Type>(cell % Rules::width));
+    }
+
+    template <typename Rules>
+    typename Rules::Mask get_occupied_cells(const SearchState<Rules>& state) {
+        return state.cells[static_cast<U8>(Player::O)] | state.cells[static_cast<U8>(Player::X)];
+    }
+
+    template <typename Rules>
+    typename Rules::Mask get_empty_cells(const SearchState<Rules>& state) {
+        return static_cast<typename Rules::Mask>(~get_occupied_cells(state) & full_mask<Rules>);
+    }
+
+    template <typename Rules>
+    Cell get_cell(const SearchState<Rules>& state, Coordinate coord) {
+        const CellIndex cell = index<Rules>(coord);
+        if (has_cell(state.cells[static_cast<U8>(Player::O)], cell)) {
+            return Cell::O;
+        }
+
+        if (has_cell(state.cells[static_cast<U8>(Player::X)], cell)) {
+            return Cell::X;
+        }
+
+        return Cell::Empty;
+    }
+
+    template <typename Rules>
+    Cell get_cell(const Board<Rules>& board, Coordinate coord) {
+        return get_cell(board.state, coord);
+    }
+
+    template <typename Rules>
+    void set_cell(SearchState<Rules>& state, CellIndex cell, Player p) {
+        assert(!has_cell(get_occupied_cells(state), cell));
+        state.cells[static_cast<U8>(p)] |= get_cell_mask<typename Rules::Mask>(cell);
+    }
+
+    template <typename Rules>
+    void clear_cell(SearchState<Rules>& state, CellIndex cell) {
+        const typename Rules::Mask mask = ~get_cell_mask<typename Rules::Mask>(cell);
+        state.cells[static_cast<U8>(Player::O)] &= mask;
+        state.cells[static_cast<U8>(Player::X)] &= mask;
+    }
+
+    template <typename Rules>
+    struct ZobristKeys {
+        U64 keys[2][Rules::cell_count]; // indexed by Player and cell
+    };
+
+    // fixed at compile time, so a position hashes the same in every run
+    template <typename Rules>
+    constexpr ZobristKeys<Rules> zobrist_keys = [] {
+        ZobristKeys<Rules> result{};
+        U64 seed = 0x7A0B2157;
+        for (auto& player_keys : result.keys) {
+            for (U64& key : player_keys) {
+                key = util::splitmix64(seed);
+            }
+        }
+        return result;
+    }();
+
+    // zobrist hashing, a position hashes to the xor of one random key per piece on the board
+    // so a move updates the hash with a single xor, the side to move follows from the pieces
+    template <typename Rules>
+    U64 get_zobrist_key(Player player, CellIndex cell) {
+        return zobrist_keys<Rules>.keys[static_cast<U8>(player)][cell];
+    }
+
+    template <typename Rules>
+    U64 get_hash(const SearchState<Rules>& state) {
+        U64 result = 0;
+        for (U8 player = 0; player < 2; ++player) {
+            for (typename Rules::Mask cells = state.cells[player]; cells; cells = without_first_cell(cells)) {
+                result ^= zobrist_keys<Rules>.keys[player][get_first_cell(cells)];
+            }
+        }
+        return result;
+    }
+
+    // at most win_length lines in each of the 4 directions pass through one cell
+    template <typename Rules>
+    struct CellLines {
+        U16 lines[Rules::cell_count][4 * Rules::win_length]; // indices into win_lines
+        U8 counts[Rules::cell_count];
+    };
+
+    // the win lines through every cell, so a move only has to check the lines it can have completed
+    template <typename Rules>
+    constexpr CellLines<Rules> cell_lines = [] {
+        CellLines<Rules> result{};
+        for (U32 line = 0; line < win_line_count<Rules>; ++line) {
+            for (CellIndex cell = 0; cell < Rules::cell_count; ++cell) {
+                if (has_cell(win_lines<Rules>.lines[line], cell)) {
+                    result.lines[cell][result.counts[cell]] = static_cast<U16>(line);
+                    ++result.counts[cell];
+                }
+            }
+        }
+        return result;
+    }();
+
+    template <typename Rules>
+    bool completes_line(const typename Rules::Mask& cells, CellIndex move) {
+        for (U32 i = 0; i < cell_lines<Rules>.counts[move]; ++i) {
+            const typename Rules::Mask& line = win_lines<Rules>.lines[cell_lines<Rules>.lines[move][i]];
+            if ((cells & line) == line) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // only the player who just moved can have won, and only with a line through their move
+    // O moves first, so nobody has win_length pieces before ply 2 * win_length - 1
+    template <typename Rules>
+    void detect_win(SearchState<Rules>& state, CellIndex last_move) {
+        const Player mover = other(state.next_turn);
+        if (state.ply >= 2 * Rules::win_length - 1 && completes_line<Rules>(state.cells[static_cast<U8>(mover)], last_move)) {
+            state.game_end = mover == Player::O ? GameEnd::OWin : GameEnd::XWin;
+        } else if (state.ply == Rules::cell_count) {
+            state.game_end = GameEnd::Draw;
+        } else {
+            state.game_end = GameEnd::None;
+        }
+    }
+
+    // every cell of every line the winning move completed, empty unless the game was won
+    // only the ui needs these, so they are worked out when asked for rather than on every move
+    template <typename Rules>
+    typename Rules::Mask get_winning_cells(const Board<Rules>& board) {
+        typename Rules::Mask result{};
+        if (board.state.game_end != GameEnd::OWin && board.state.game_end != GameEnd::XWin) {
+            return result;
+        }
+
+        const Player winner = board.state.game_end == GameEnd::OWin ? Player::O : Player::X;
+        const typename Rules::Mask& cells = board.state.cells[static_cast<U8>(winner)];
+        const CellIndex last_move = index<Rules>(board.history[board.state.ply - 1]);
+        for (U32 i = 0; i < cell_lines<Rules>.counts[last_move]; ++i) {
+            const typename Rules::Mask& line = win_lines<Rules>.lines[cell_lines<Rules>.lines[last_move][i]];
+            if ((cells & line) == line) {
+                result |= line;
+            }
+        }
+        return result;
+    }
+
+    template <typename Rules>
+    void play_move(SearchState<Rules>& state, CellIndex cell) {
+        assert(state.game_end == GameEnd::None);
+        assert(state.ply < Rules::cell_count);
+
+        set_cell(state, cell, state.next_turn);
+        state.next_turn = other(state.next_turn);
+        ++state.ply;
+        detect_win(state, cell);
+    }
+
+    template <typename Rules>
+    void play_move(Board<Rules>& board, Coordinate coord, bool is_redo = false) {
+        if (board.state.game_end == GameEnd::None && has_cell(get_empty_cells(board.state), index<Rules>(coord))) {
+            board.history[board.state.ply] = coord;
+            play_move(board.state, index<Rules>(coord));
+            board.ai_best_moves_count = 0;
+            if (!is_redo) {
+                board.history_count = board.state.ply;
+            }
+        }
+    }
+
+    template <typename Rules>
+    bool can_undo(const Board<Rules>& board) {
+        return board.state.ply > 0;
+    }
+
+    template <typename Rules>
+    bool can_redo(const Board<Rules>& board) {
+        return board.state.ply < board.history_count;
+    }
+
+    template <typename Rules>
+    bool undo(Board<Rules>& board) {
+        assert(can_undo(board));
+        Coordinate coord = board.history[board.state.ply - 1];
+        assert(get_cell(board, coord) != Cell::Empty);
+        clear_cell(board.state, index<Rules>(coord));
+        --board.state.ply;
+        board.state.game_end = GameEnd::None;
+        board.state.next_turn = other(board.state.next_turn);
+        board.ai_best_moves_count = 0;
+        return true;
+    }
+
+    template <typename Rules>
+    bool redo(Board<Rules>& board) {
+        assert(can_redo(board));
+        Coordinate coord = board.history[board.state.ply];
+        play_move(board, coord, true);
+        return true;
+    }
+
+    template <typename Rules>
+    void play_computer_move(Board<Rules>& board, util::Rng& rng) {
+        assert(board.ai_best_moves_count > 0);
+        const U32 index = util::random_below(rng, board.ai_best_moves_count);
+        const Coordinate coord = board.ai_best_moves[index];
+        play_move(board, coord);
+    }
+
+    template <typename Rules>
+    CellIndex get_random_move(const SearchState<Rules>& state, util::Rng& rng) {
+        const typename Rules::Mask empty_cells = get_empty_cells(state);
+        const U32 num_possible_moves = count_cells(empty_cells);
+        assert(num_possible_moves > 0);
+        const U32 potential_move_index = num_possible_moves == 1 ? 0 : util::random_below(rng, num_possible_moves);
+        return get_nth_cell(empty_cells, potential_move_index);
+    }
 } // namespace engine
 } // namespace tic_tac_toe
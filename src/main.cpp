@@ -1,6 +1,9 @@
 
 #include "engine.cpp"
+#include "thread_pool.cpp"
+#include "rollout.cpp"
 #include "mcts.cpp"
+#include "perfect_play.cpp"
 #include "tree_search.cpp"
 #include "ui.cpp"
 
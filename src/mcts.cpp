@@ -2,317 +2,1595 @@
 #include "mcts.hpp"
 #include "engine.hpp"
 #include "util.hpp"
+#include "thread_pool.hpp"
+#include "rollout.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 namespace tic_tac_toe {
 namespace mcts {
-    struct Node {
-        Node() = default;
+    using NodeIndex = U32;
+    using EdgeIndex = U32;
+    static constexpr NodeIndex invalid_node_index = 0xFFFFFFFF;
+    static constexpr EdgeIndex invalid_edge_index = 0xFFFFFFFF;
 
-        ~Node() {
-            for (U8 i = 0; i < children_count; ++i) {
-                delete children[i];
-            }
-        }
+    using Clock = std::chrono::steady_clock;
 
-        engine::Coordinate coord;
-        double score; // numerator
-        double visit_count; // denominator
-        Node* parent;
-        Node* children[9];
-        U8 children_count;
+    // the move of an edge, every board the search is instantiated for has at most 256 cells
+    using EdgeCell = U8;
+
+    // a move's score in half points, 2 for a win and 1 for a draw
+    // integers stay exact past the 2^24 visits where adding to a float stops counting,
+    // and tree parallel threads add them with one atomic instruction instead of a compare and swap loop
+    using Score = U32;
+
+    enum class Expansion : U8 {
+        None,
+        InProgress // claimed by a tree parallel thread that is adding an edge
+    };
+
+    // a node's edges are allocated in blocks of this many, chained through NodePool::edge_next_blocks,
+    // so a node only takes memory for the moves that have been tried
+    static constexpr U32 edge_block_size = 8;
+
+    // a position, shared by every move order that reaches it, so the search graph is a dag rather than a tree
+    // its moves get an edge the first time they are tried, the untried ones are the empty cells without one
+    struct Node {
+        U64 hash;
+        EdgeIndex first_edge; // the first block of edges, only valid while edge_count > 0
+        engine::CellIndex edge_count; // moves tried so far
+        Expansion expansion;
         engine::Player perspective;
     };
+    // its visit count lives in a parallel array, and its moves on edges, so a node is no bigger than this
+    static_assert(sizeof(Node) == 16);
 
-    template <typename FilterFunction>
-    static Node* random_child(Node& node, FilterFunction filter) {
-        U8 count = 0;
-        U8 indices[9];
+    // maps a position's zobrist hash to its node
+    // fixed capacity and set associative, a full bucket gives up its least visited node
+    // a node that loses its entry stays in the dag, it just can no longer be found by other move orders
+    struct TranspositionTable {
+        std::unique_ptr<NodeIndex[]> entries; // invalid_node_index when empty
+        U32 bucket_mask;
+    };
 
-        for (U8 i = 0; i < node.children_count; ++i) {
-            if (filter(*node.children[i])) {
-                indices[count] = i;
-                ++count;
-            }
+    static constexpr U32 bucket_size = 4;
+
+    // bump allocator owning every node and edge of one search
+    // nothing is freed individually, the whole dag is released at once by destruction
+    // a move's statistics live on its edge rather than on the node it leads to, because that node can have several parents
+    // edge arrays are parallel, so the stats of the moves in a block are contiguous
+    struct NodePool {
+        std::unique_ptr<Node[]> nodes;
+        std::unique_ptr<U32[]> node_visit_counts; // through any parent
+        std::unique_ptr<Proof[]> node_proofs; // for the player to move
+        U32 node_capacity;
+        U32 node_count;
+
+        std::unique_ptr<EdgeCell[]> edge_cells;
+        std::unique_ptr<NodeIndex[]> edge_children; // invalid_node_index until the move is first played
+        std::unique_ptr<U32[]> edge_visit_counts; // denominator
+        std::unique_ptr<Score[]> edge_scores; // numerator
+        std::unique_ptr<EdgeIndex[]> edge_next_blocks; // indexed by block, the next block of the same node
+        // all moves as first statistics, only allocated for rave
+        std::unique_ptr<U32[]> edge_amaf_visit_counts;
+        std::unique_ptr<Score[]> edge_amaf_scores;
+        U32 edge_capacity; // a multiple of edge_block_size
+        U32 edge_count;
+
+        TranspositionTable transpositions;
+    };
+
+    // about 220 MB of edges, past that expansion fails and the search stops
+    static constexpr U32 max_edge_count = 1 << 24;
+
+    // nodes and edges are left uninitialised until allocated, so unused capacity is never touched
+    // the table gets one entry per node rounded up to a power of two, so buckets rarely fill up
+    static void init(NodePool& pool, U32 node_capacity, U32 edge_capacity, bool amaf) {
+        assert(node_capacity < invalid_node_index);
+        assert(edge_capacity < invalid_edge_index && edge_capacity % edge_block_size == 0);
+        pool.nodes.reset(new Node[node_capacity]);
+        pool.node_visit_counts.reset(new U32[node_capacity]);
+        pool.node_proofs.reset(new Proof[node_capacity]);
+        pool.node_capacity = node_capacity;
+        pool.node_count = 0;
+
+        pool.edge_cells.reset(new EdgeCell[edge_capacity]);
+        pool.edge_children.reset(new NodeIndex[edge_capacity]);
+        pool.edge_visit_counts.reset(new U32[edge_capacity]);
+        pool.edge_scores.reset(new Score[edge_capacity]);
+        pool.edge_next_blocks.reset(new EdgeIndex[edge_capacity / edge_block_size]);
+        pool.edge_amaf_visit_counts.reset(amaf ? new U32[edge_capacity] : nullptr);
+        pool.edge_amaf_scores.reset(amaf ? new Score[edge_capacity] : nullptr);
+        pool.edge_capacity = edge_capacity;
+        pool.edge_count = 0;
+
+        const U32 entry_count = std::bit_ceil(util::max(node_capacity, bucket_size));
+        pool.transpositions.entries.reset(new NodeIndex[entry_count]);
+        std::fill_n(pool.transpositions.entries.get(), entry_count, invalid_node_index);
+        pool.transpositions.bucket_mask = entry_count / bucket_size - 1;
+    }
+
+    // tree parallel threads share one pool, so every access to shared stats goes through atomic_ref
+    template <bool SharedTree, typename T>
+    static T load(T& value) {
+        if constexpr (SharedTree) {
+            return std::atomic_ref<T>(value).load(std::memory_order_relaxed);
+        } else {
+            return value;
         }
-        
-        if (count == 0) {
-            return nullptr;
+    }
+
+    template <bool SharedTree, typename T>
+    static void store(T& value, T desired) {
+        if constexpr (SharedTree) {
+            std::atomic_ref<T>(value).store(desired, std::memory_order_relaxed);
+        } else {
+            value = desired;
         }
+    }
 
-        return node.children[indices[util::random(0, count)]];
+    template <bool SharedTree, typename T>
+    static T fetch_add(T& value, T amount) {
+        if constexpr (SharedTree) {
+            return std::atomic_ref<T>(value).fetch_add(amount, std::memory_order_relaxed);
+        } else {
+            const T result = value;
+            value += amount;
+            return result;
+        }
     }
 
-    static double uct(double score, double visit_count, double parent_visit_count) {
-        static const double c = sqrt(2.0);
-        return score / visit_count + c * sqrt(log(parent_visit_count) / visit_count);
+    // links to nodes are published with release and read with acquire, so a node is fully written before
+    // another thread can reach it
+    template <bool SharedTree>
+    static NodeIndex load_link(NodeIndex& link) {
+        if constexpr (SharedTree) {
+            return std::atomic_ref<NodeIndex>(link).load(std::memory_order_acquire);
+        } else {
+            return link;
+        }
     }
 
-    enum struct SelectChildHandleWithHighestValue_CollisionResolutionStrategy {
-        None,
-        Random
-    };
+    // on failure expected is set to the link another thread stored first
+    template <bool SharedTree>
+    static bool compare_exchange_link(NodeIndex& link, NodeIndex& expected, NodeIndex desired) {
+        if constexpr (SharedTree) {
+            return std::atomic_ref<NodeIndex>(link).compare_exchange_strong(expected, desired, std::memory_order_acq_rel);
+        } else {
+            if (link != expected) {
+                expected = link;
+                return false;
+            }
+            link = desired;
+            return true;
+        }
+    }
+
+    // returns the first of count consecutive slots, or invalid_node_index once capacity is used up
+    // a failed allocation leaves used as it was, so it never passes capacity however often allocation is retried
+    template <bool SharedTree>
+    static U32 allocate(U32& used, U32 capacity, U32 count) {
+        if constexpr (SharedTree) {
+            std::atomic_ref<U32> used_ref(used);
+            U32 result = used_ref.load(std::memory_order_relaxed);
+            do {
+                if (capacity - result < count) {
+                    return invalid_node_index;
+                }
+            } while (!used_ref.compare_exchange_weak(result, result + count, std::memory_order_relaxed));
+            return result;
+        } else {
+            if (capacity - used < count) {
+                return invalid_node_index;
+            }
 
-    template <SelectChildHandleWithHighestValue_CollisionResolutionStrategy CollisionResolutionStrategy>
-    static Node* select_child_with_highest_value(Node& node, int (*comparator_function)(const Node& a, const Node& b)) {
-        if (node.children_count == 0) {
-            return nullptr;
+            const U32 result = used;
+            used += count;
+            return result;
         }
+    }
 
-        U8 highest_count = 1;
-        U8 highest_indices[9];
+    // the nodes handed out so far
+    static U32 get_allocated_count(const NodePool& pool) {
+        return pool.node_count;
+    }
 
-        {
-            Node& child = *node.children[0];
-            highest_indices[0] = 0;
+    // returns invalid_node_index if no node of the position is in the table
+    template <bool SharedTree>
+    static NodeIndex find(NodePool& pool, U64 hash) {
+        NodeIndex* bucket = pool.transpositions.entries.get() + (hash & pool.transpositions.bucket_mask) * bucket_size;
+        for (U32 i = 0; i < bucket_size; ++i) {
+            const NodeIndex node_index = load_link<SharedTree>(bucket[i]);
+            if (node_index != invalid_node_index && pool.nodes[node_index].hash == hash) {
+                return node_index;
+            }
         }
 
-        for (U8 i = 1; i < node.children_count; ++i) {
-            const Node& child = *node.children[i];
-            const int compare_result = comparator_function(*node.children[highest_indices[0]], child);
-            if (compare_result > 0) {
-                highest_count = 1;
-                highest_indices[0] = i;
-            } else if (compare_result == 0) {
-                highest_indices[highest_count] = i;
-                ++highest_count;
+        return invalid_node_index;
+    }
+
+    // returns the node the table ends up with for the position, another thread's if it inserted one first
+    template <bool SharedTree>
+    static NodeIndex insert(NodePool& pool, NodeIndex node_index) {
+        const U64 hash = pool.nodes[node_index].hash;
+        NodeIndex* bucket = pool.transpositions.entries.get() + (hash & pool.transpositions.bucket_mask) * bucket_size;
+        for (U32 i = 0; i < bucket_size; ++i) {
+            NodeIndex current = load_link<SharedTree>(bucket[i]);
+            if (current == invalid_node_index && compare_exchange_link<SharedTree>(bucket[i], current, node_index)) {
+                return node_index;
+            }
+            if (pool.nodes[current].hash == hash) {
+                return current;
+            }
+        }
+
+        // the bucket is full, replace its least visited node
+        U32 victim = 0;
+        U32 victim_visit_count = 0xFFFFFFFF;
+        NodeIndex victim_node = invalid_node_index;
+        for (U32 i = 0; i < bucket_size; ++i) {
+            const NodeIndex current = load_link<SharedTree>(bucket[i]);
+            const U32 visit_count = load<SharedTree>(pool.node_visit_counts[current]);
+            if (visit_count < victim_visit_count) {
+                victim = i;
+                victim_visit_count = visit_count;
+                victim_node = current;
             }
         }
 
-        assert(highest_count > 0);
+        // if another thread replaced it first the node simply stays out of the table
+        compare_exchange_link<SharedTree>(bucket[victim], victim_node, node_index);
+        return node_index;
+    }
 
-        if constexpr (CollisionResolutionStrategy == SelectChildHandleWithHighestValue_CollisionResolutionStrategy::Random) {
-            const U8 index = highest_count == 1 ? 0 : util::random(0, highest_count);
+    // the node a move leads to, found through the transposition table or created the first time the move is played
+    // returns invalid_node_index if the pool is full
+    template <bool SharedTree>
+    static NodeIndex get_child(NodePool& pool, EdgeIndex edge_index, U64 hash, engine::Player perspective) {
+        NodeIndex child = load_link<SharedTree>(pool.edge_children[edge_index]);
+        if (child != invalid_node_index) {
+            return child;
+        }
 
-            assert(highest_indices[index] < node.children_count);
-            return node.children[highest_indices[index]];
-        } else {
-            if (highest_count == 1) {
-                return node.children[highest_indices[0]];
+        child = find<SharedTree>(pool, hash);
+        if (child == invalid_node_index) {
+            child = allocate<SharedTree>(pool.node_count, pool.node_capacity, 1);
+            if (child == invalid_node_index) {
+                return invalid_node_index;
             }
 
-            return nullptr;
+            Node& node = pool.nodes[child];
+            node.hash = hash;
+            node.first_edge = invalid_edge_index;
+            node.edge_count = 0;
+            node.expansion = Expansion::None;
+            node.perspective = perspective;
+            pool.node_visit_counts[child] = 0;
+            pool.node_proofs[child] = Proof::None;
+            child = insert<SharedTree>(pool, child);
         }
+
+        NodeIndex expected = invalid_node_index;
+        compare_exchange_link<SharedTree>(pool.edge_children[edge_index], expected, child);
+        return expected == invalid_node_index ? child : expected;
     }
-    
-    template <typename ResultType>
-    static U8 children_with_highest_value(Node& node, ResultType result[9], int (*comparator_function)(const Node& a, const Node& b), ResultType (*child_to_result)(Node& child)) {
-        if (node.children_count == 0) {
-            return 0;
-        }
 
-        U8 highest_count = 1;
-        U8 highest_indices[9];
+    static constexpr float exploration = 1.41421356f; // sqrt(2)
+    static constexpr float infinity = std::numeric_limits<float>::infinity();
+
+    // writes the uct value of every child to values and returns the highest one
+    // unvisited children get infinity so they are always tried first
+    // scores are in half points, so the mean is score / 2n
+    static float uct_values(const U32* visit_counts, const Score* scores, U32 count, float log_parent_visit_count, float* values) {
+        U32 i = 0;
+        float highest = -infinity;
+
+#if defined(__AVX2__)
+        {
+            const __m256 log_n = _mm256_set1_ps(log_parent_visit_count);
+            const __m256 c = _mm256_set1_ps(exploration);
+            const __m256 inf = _mm256_set1_ps(infinity);
+            const __m256 zero = _mm256_setzero_ps();
+            __m256 highest_8 = _mm256_set1_ps(-infinity);
+            for (; i + 8 <= count; i += 8) {
+                const __m256 n = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(visit_counts + i)));
+                const __m256 score = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(scores + i)));
+                const __m256 value = _mm256_add_ps(_mm256_div_ps(score, _mm256_add_ps(n, n)), _mm256_mul_ps(c, _mm256_sqrt_ps(_mm256_div_ps(log_n, n))));
+                const __m256 result = _mm256_blendv_ps(value, inf, _mm256_cmp_ps(n, zero, _CMP_EQ_OQ));
+                _mm256_storeu_ps(values + i, result);
+                highest_8 = _mm256_max_ps(highest_8, result);
+            }
 
+            __m128 highest_4 = _mm_max_ps(_mm256_castps256_ps128(highest_8), _mm256_extractf128_ps(highest_8, 1));
+            highest_4 = _mm_max_ps(highest_4, _mm_movehl_ps(highest_4, highest_4));
+            highest_4 = _mm_max_ss(highest_4, _mm_shuffle_ps(highest_4, highest_4, 1));
+            highest = _mm_cvtss_f32(highest_4);
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
         {
-            Node& child = *node.children[0];
-            highest_indices[0] = 0;
+            const __m128 log_n = _mm_set1_ps(log_parent_visit_count);
+            const __m128 c = _mm_set1_ps(exploration);
+            const __m128 inf = _mm_set1_ps(infinity);
+            const __m128 zero = _mm_setzero_ps();
+            __m128 highest_4 = _mm_set1_ps(-infinity);
+            for (; i + 4 <= count; i += 4) {
+                const __m128 n = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(visit_counts + i)));
+                const __m128 score = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(scores + i)));
+                const __m128 value = _mm_add_ps(_mm_div_ps(score, _mm_add_ps(n, n)), _mm_mul_ps(c, _mm_sqrt_ps(_mm_div_ps(log_n, n))));
+                const __m128 unvisited = _mm_cmpeq_ps(n, zero);
+                const __m128 result = _mm_or_ps(_mm_and_ps(unvisited, inf), _mm_andnot_ps(unvisited, value));
+                _mm_storeu_ps(values + i, result);
+                highest_4 = _mm_max_ps(highest_4, result);
+            }
+
+            highest_4 = _mm_max_ps(highest_4, _mm_movehl_ps(highest_4, highest_4));
+            highest_4 = _mm_max_ss(highest_4, _mm_shuffle_ps(highest_4, highest_4, 1));
+            highest = _mm_cvtss_f32(highest_4);
         }
+#endif
 
-        for (U8 i = 1; i < node.children_count; ++i) {
-            const Node& child = *node.children[i];
-            const int compare_result = comparator_function(*node.children[highest_indices[0]], child);
-            if (compare_result > 0) {
-                highest_count = 1;
-                highest_indices[0] = i;
-            } else if (compare_result == 0) {
-                highest_indices[highest_count] = i;
-                ++highest_count;
+        for (; i < count; ++i) {
+            const float n = static_cast<float>(visit_counts[i]);
+            values[i] = visit_counts[i] == 0 ? infinity : static_cast<float>(scores[i]) / (n + n) + exploration * std::sqrt(log_parent_visit_count / n);
+            highest = values[i] > highest ? values[i] : highest;
+        }
+
+        return highest;
+    }
+
+    // the count is published with release once the edge behind it is written, so it is read with acquire
+    template <bool SharedTree>
+    static engine::CellIndex load_edge_count(Node& node) {
+        if constexpr (SharedTree) {
+            return std::atomic_ref<engine::CellIndex>(node.edge_count).load(std::memory_order_acquire);
+        } else {
+            return node.edge_count;
+        }
+    }
+
+    // calls f(first_edge, first, n) for the blocks holding the first count edges of the node, in the order they were added,
+    // where first counts the edges of the blocks before and n is how many of the block's edges are wanted
+    // only the links up to the last block needed are read, another thread may be writing the one after it,
+    // and first_edge not at all without edges, another thread may be giving the node its first
+    template <typename F>
+    static void for_each_block(const NodePool& pool, const Node& node, engine::CellIndex count, F f) {
+        if (count == 0) {
+            return;
+        }
+
+        EdgeIndex block = node.first_edge;
+        for (engine::CellIndex first = 0; first < count; first += edge_block_size) {
+            if (first > 0) {
+                block = pool.edge_next_blocks[block / edge_block_size];
             }
+            f(block, first, util::min(count - first, edge_block_size));
         }
+    }
+
+    // calls f(edge, i) for the first count edges of the node, in the order they were added
+    template <typename F>
+    static void for_each_edge(const NodePool& pool, const Node& node, engine::CellIndex count, F f) {
+        for_each_block(pool, node, count, [&f](EdgeIndex block, engine::CellIndex first, U32 n) {
+            for (U32 i = 0; i < n; ++i) {
+                f(block + i, static_cast<engine::CellIndex>(first + i));
+            }
+        });
+    }
+
+    // the proof of the position a move leads to, Proof::None until the move has been played
+    template <bool SharedTree>
+    static Proof get_child_proof(NodePool& pool, EdgeIndex edge) {
+        const NodeIndex child = load_link<SharedTree>(pool.edge_children[edge]);
+        return child == invalid_node_index ? Proof::None : load<SharedTree>(pool.node_proofs[child]);
+    }
 
-        for (U8 i = 0; i < highest_count; ++i) {
-            result[i] = child_to_result(*node.children[highest_indices[i]]);
+    // the same proof seen by the other player
+    static Proof flip(Proof proof) {
+        return proof == Proof::Win ? Proof::Loss : proof == Proof::Loss ? Proof::Win : proof;
+    }
+
+    // rave, the mean of every move is blended with its all moves as first mean, weighted by
+    // beta = sqrt(equivalence / (3n + equivalence)), so amaf decides before the first visit and fades as real visits come in
+    // a move with no visits of either kind gets infinity so it is tried first
+    static float rave_values(const U32* visit_counts, const Score* scores, const U32* amaf_visit_counts, const Score* amaf_scores, U32 count,
+        float log_parent_visit_count, float equivalence, float* values) {
+        float highest = -infinity;
+        for (U32 i = 0; i < count; ++i) {
+            const float n = static_cast<float>(visit_counts[i]);
+            const float amaf_n = static_cast<float>(amaf_visit_counts[i]);
+            if (visit_counts[i] == 0 && amaf_visit_counts[i] == 0) {
+                values[i] = infinity;
+            } else {
+                const float mean = visit_counts[i] == 0 ? 0.0f : static_cast<float>(scores[i]) / (n + n);
+                const float amaf_mean = amaf_visit_counts[i] == 0 ? 0.0f : static_cast<float>(amaf_scores[i]) / (amaf_n + amaf_n);
+                const float beta = amaf_visit_counts[i] == 0 ? 0.0f : std::sqrt(equivalence / (3.0f * n + equivalence));
+                values[i] = (1.0f - beta) * mean + beta * amaf_mean + exploration * std::sqrt(log_parent_visit_count / (n > 1.0f ? n : 1.0f));
+            }
+            highest = values[i] > highest ? values[i] : highest;
         }
 
-        return highest_count;
+        return highest;
     }
 
-    static Node& select(engine::Board& board, Node& node) {
-        // if game is over at this node, select this node
-        if (board.game_end != engine::GameEnd::None) {
-            return node;
-        }
-
-        // if this node has not been visited, select this node
-        if (node.visit_count == 0.0 && node.parent != nullptr) {
-            // this should not be possible
-            assert(false);
-            return node;
-        }
-
-        // if this node has no children, create all possible children, and randomly select one of them
-        if (node.children_count == 0) {
-            // create a new node for every possible move
-            for (U8 i = 0; i < 9; ++i) {
-                const engine::Coordinate coord(i);
-                if (get_cell(board, coord) == engine::Cell::Empty) {
-                    node.children[node.children_count] = static_cast<Node*>(malloc(sizeof(Node)));
-                    Node& child = *node.children[node.children_count];
-                    child.coord = coord;
-                    child.score = 0.0;
-                    child.visit_count = 0.0;
-                    child.parent = &node;
-                    child.children_count = 0;
-                    child.perspective = other(node.perspective);
-                    ++node.children_count;
+    // returns invalid_edge_index if every move the node has tried is proven to win or lose
+    template <typename Rules, bool SharedTree>
+    static EdgeIndex select_edge_with_highest_uct(NodePool& pool, NodeIndex node_index, engine::CellIndex edge_count, const Config& config, util::Rng& rng) {
+        assert(edge_count > 0);
+
+        const U32 parent_visit_count = util::max(load<SharedTree>(pool.node_visit_counts[node_index]), 1);
+        const float log_parent_visit_count = std::log(static_cast<float>(parent_visit_count));
+
+        // a block is one simd batch of the kernel
+        EdgeIndex blocks[(Rules::cell_count + edge_block_size - 1) / edge_block_size];
+        float values[Rules::cell_count];
+        float highest = -infinity;
+        for_each_block(pool, pool.nodes[node_index], edge_count, [&](EdgeIndex block, engine::CellIndex first, U32 n) {
+            blocks[first / edge_block_size] = block;
+            const U32* visit_counts = pool.edge_visit_counts.get() + block;
+            const Score* scores = pool.edge_scores.get() + block;
+
+            // other threads keep updating the stats, so the kernel works on a copy
+            U32 visit_counts_copy[edge_block_size];
+            Score scores_copy[edge_block_size];
+            if constexpr (SharedTree) {
+                for (U32 i = 0; i < n; ++i) {
+                    visit_counts_copy[i] = load<SharedTree>(pool.edge_visit_counts[block + i]);
+                    scores_copy[i] = load<SharedTree>(pool.edge_scores[block + i]);
                 }
+                visit_counts = visit_counts_copy;
+                scores = scores_copy;
             }
 
-            if (node.children_count == 0) {
-                // this should not be able to happen, otherwise board.game_end should not be GameEnd::None
-                assert(false);
-                return node;
+            float block_highest;
+            if (config.rave) {
+                U32 amaf_visit_counts[edge_block_size];
+                Score amaf_scores[edge_block_size];
+                for (U32 i = 0; i < n; ++i) {
+                    amaf_visit_counts[i] = load<SharedTree>(pool.edge_amaf_visit_counts[block + i]);
+                    amaf_scores[i] = load<SharedTree>(pool.edge_amaf_scores[block + i]);
+                }
+                block_highest = rave_values(visit_counts, scores, amaf_visit_counts, amaf_scores, n, log_parent_visit_count, config.rave_equivalence, values + first);
+            } else {
+                block_highest = uct_values(visit_counts, scores, n, log_parent_visit_count, values + first);
             }
+            highest = block_highest > highest ? block_highest : highest;
+        });
 
-            const U8 index = util::random(0, node.children_count);
-            Node& result = *node.children[index];
-            play_move(board, result.coord);
-            return result;
+        // a move proven to win or lose needs no more visits, a proven draw keeps getting them so its visits
+        // stay comparable to those of the moves still being searched
+        // proven moves are rare, so only the chosen one is checked and the choice made again without it if it is proven
+        while (highest != -infinity) {
+            U32 highest_count = 0;
+            engine::CellIndex highest_indices[Rules::cell_count];
+            for (engine::CellIndex i = 0; i < edge_count; ++i) {
+                if (values[i] == highest) {
+                    highest_indices[highest_count] = i;
+                    ++highest_count;
+                }
+            }
+
+            assert(highest_count > 0);
+            const U32 index = highest_count == 1 ? 0 : util::random_below(rng, highest_count);
+            const engine::CellIndex selected = highest_indices[index];
+            const EdgeIndex edge = blocks[selected / edge_block_size] + selected % edge_block_size;
+            const Proof proof = get_child_proof<SharedTree>(pool, edge);
+            if (proof == Proof::None || proof == Proof::Draw) {
+                return edge;
+            }
+
+            values[selected] = -infinity;
+            highest = -infinity;
+            for (engine::CellIndex i = 0; i < edge_count; ++i) {
+                highest = values[i] > highest ? values[i] : highest;
+            }
         }
 
-        {
-            // if some children have no visits, one of them should be visited next
-            // check seperately instead of calculating uct to avoid dividing by zero
-            Node* child = random_child(node, [](Node& child) {
-                return child.visit_count == 0.0;
-            });
+        return invalid_edge_index;
+    }
+
+    // how many of its empty_count moves a node with visit_count visits may have tried
+    // rave keeps amaf statistics on the edges, so it needs every move to have one and does no widening
+    static U32 get_allowed_edge_count(U32 empty_count, U32 visit_count, const Config& config) {
+        if (config.widening_scale <= 0.0f || config.rave) {
+            return empty_count;
+        }
 
-            if (child) {
-                engine::play_move(board, child->coord);
-                return *child;
+        const float limit = std::ceil(config.widening_scale * std::pow(static_cast<float>(visit_count), config.widening_exponent));
+        return limit < 1.0f ? 1 : limit >= static_cast<float>(empty_count) ? empty_count : static_cast<U32>(limit);
+    }
+
+    // gives the node edges for up to added_count of its untried moves, picked at random, without going past allowed_count edges
+    // the untried moves are the empty cells no edge has, so they need no storage of their own
+    // the node a move leads to is only looked up when the move is first played
+    // returns the first edge added, or invalid_edge_index if another thread is adding edges to the node, no edge is allowed
+    // or the pool is full
+    template <typename Rules, bool SharedTree>
+    static EdgeIndex add_edges(const engine::SearchState<Rules>& state, NodePool& pool, NodeIndex node_index, U32 allowed_count, U32 added_count, util::Rng& rng) {
+        static_assert(Rules::cell_count <= 256, "every move must fit an EdgeCell");
+        using Mask = typename Rules::Mask;
+        Node& node = pool.nodes[node_index];
+        if constexpr (SharedTree) {
+            Expansion expected = Expansion::None;
+            if (!std::atomic_ref<Expansion>(node.expansion).compare_exchange_strong(expected, Expansion::InProgress, std::memory_order_acquire)) {
+                return invalid_edge_index;
             }
         }
 
-        {
-            Node* child = select_child_with_highest_value
-            <SelectChildHandleWithHighestValue_CollisionResolutionStrategy::Random>(node, [](const Node& a, const Node& b) {
-                assert(a.parent != nullptr);
-                assert(a.parent == b.parent);
-                const double result = uct(b.score, b.visit_count, b.parent->visit_count) - uct(a.score, a.visit_count, a.parent->visit_count);
-                return (result < 0) ? -1 : (result > 0) ? 1 : 0;
+        // only the thread holding the claim changes the edges, so they can be read directly
+        engine::CellIndex edge_count = node.edge_count;
+        EdgeIndex result = invalid_edge_index;
+        if (edge_count < allowed_count) {
+            Mask tried{};
+            EdgeIndex last_edge = invalid_edge_index;
+            for_each_edge(pool, node, edge_count, [&](EdgeIndex edge, engine::CellIndex) {
+                tried |= engine::get_cell_mask<Mask>(pool.edge_cells[edge]);
+                last_edge = edge;
             });
+            Mask untried = static_cast<Mask>(engine::get_empty_cells(state) ^ tried);
+            U32 untried_count = engine::count_cells(untried);
+            // otherwise allowed_count would be more than the empty cells
+            assert(untried_count > 0);
+
+            for (U32 i = 0; i < added_count && edge_count < allowed_count; ++i) {
+                EdgeIndex edge;
+                if (edge_count % edge_block_size != 0) {
+                    edge = last_edge + 1;
+                } else {
+                    edge = allocate<SharedTree>(pool.edge_count, pool.edge_capacity, edge_block_size);
+                    if (edge == invalid_edge_index) {
+                        break;
+                    }
+
+                    pool.edge_next_blocks[edge / edge_block_size] = invalid_edge_index;
+                    if (edge_count == 0) {
+                        node.first_edge = edge;
+                    } else {
+                        pool.edge_next_blocks[last_edge / edge_block_size] = edge;
+                    }
+                }
+
+                const U32 n = untried_count == 1 ? 0 : util::random_below(rng, untried_count);
+                const engine::CellIndex cell = engine::get_nth_cell(untried, n);
+                untried = static_cast<Mask>(untried ^ engine::get_cell_mask<Mask>(cell));
+                --untried_count;
+                pool.edge_cells[edge] = static_cast<EdgeCell>(cell);
+                pool.edge_children[edge] = invalid_node_index;
+                pool.edge_visit_counts[edge] = 0;
+                pool.edge_scores[edge] = 0;
+                if (pool.edge_amaf_visit_counts) {
+                    pool.edge_amaf_visit_counts[edge] = 0;
+                    pool.edge_amaf_scores[edge] = 0;
+                }
+
+                ++edge_count;
+                if constexpr (SharedTree) {
+                    // publishes the edge to every thread that acquires the count
+                    std::atomic_ref<engine::CellIndex>(node.edge_count).store(edge_count, std::memory_order_release);
+                } else {
+                    node.edge_count = edge_count;
+                }
 
-            assert(child);
-            engine::play_move(board, child->coord);
-            return select(board, *child);
+                result = result == invalid_edge_index ? edge : result;
+                last_edge = edge;
+            }
+        }
+
+        if constexpr (SharedTree) {
+            std::atomic_ref<Expansion>(node.expansion).store(Expansion::None, std::memory_order_release);
+        }
+        return result;
+    }
+
+    // mcts-solver, a node is a proven win once one of its moves leads to a position proven lost for the opponent,
+    // and a proven draw or loss once every move has been tried and leads to a proven position
+    template <bool SharedTree>
+    static Proof prove(NodePool& pool, NodeIndex node_index, U32 empty_count) {
+        Node& node = pool.nodes[node_index];
+        const engine::CellIndex edge_count = load_edge_count<SharedTree>(node);
+        bool win = false;
+        bool draw = false;
+        bool unproven = edge_count < empty_count;
+        for_each_edge(pool, node, edge_count, [&](EdgeIndex edge, engine::CellIndex) {
+            const Proof proof = get_child_proof<SharedTree>(pool, edge);
+            win = win || proof == Proof::Loss;
+            draw = draw || proof == Proof::Draw;
+            unproven = unproven || proof == Proof::None;
+        });
+
+        if (win) {
+            return Proof::Win;
+        }
+        if (unproven) {
+            return Proof::None;
         }
+        return draw ? Proof::Draw : Proof::Loss;
     }
 
-    static double get_score(engine::Player perspective, engine::GameEnd state) {
-        assert(state != engine::GameEnd::None);
+    // the nodes and edges from the root down to the selected node
+    // a node can have several parents, so backprop follows the path rather than links back up the dag
+    template <typename Rules>
+    struct Path {
+        NodeIndex nodes[Rules::cell_count + 1]; // the root and the node after every move
+        EdgeIndex edges[Rules::cell_count]; // edges[i] leads from nodes[i] to nodes[i + 1]
+        engine::CellIndex count; // of nodes
+    };
+
+    static constexpr bool stats_enabled = MCTS_STATS;
 
-        if (perspective == engine::Player::O) {
-            if (state == engine::GameEnd::OWin) {
-                return 1.0;
+    // what one tree or thread of a search did, added up into Stats when the search ends
+    // everything but the iteration, node and visit counts and edges_exhausted is only kept when stats_enabled
+    struct Counters {
+        U32 iteration_count;
+        U32 node_count;
+        U32 reused_visit_count;
+        U32 new_visit_count;
+        bool edges_exhausted;
+        Clock::duration select_time; // expansion included, it is taken out when the counters become Stats
+        Clock::duration expand_time;
+        Clock::duration simulate_time;
+        Clock::duration backprop_time;
+        U32 max_depth;
+        U64 rollout_count;
+        U64 rollout_move_count;
+    };
+
+    // without stats nothing reads the time, so the calls compile away
+    static Clock::time_point get_time() {
+        if constexpr (stats_enabled) {
+            return Clock::now();
+        } else {
+            return Clock::time_point{};
+        }
+    }
+
+    // every edge taken on the way down gets virtual_loss extra visits with no score until backprop
+    // replaces them, so concurrent threads in a shared tree spread out over its siblings
+    template <typename Rules, bool SharedTree>
+    static void select(engine::SearchState<Rules>& state, NodePool& pool, NodeIndex root_index, const Config& config, U32 virtual_loss, util::Rng& rng, Path<Rules>& path, Counters& counters) {
+        NodeIndex node_index = root_index;
+        U64 hash = pool.nodes[root_index].hash;
+        path.nodes[0] = root_index;
+        path.count = 1;
+
+        while (true) {
+            // if game is over at this node, select this node
+            if (state.game_end != engine::GameEnd::None) {
+                return;
             }
 
-            if (state == engine::GameEnd::XWin) {
-                return 0.0;
+            // rave adds every move at once, so their amaf statistics are gathered from the start
+            const auto try_add_edges = [&](U32 allowed_count) {
+                const Clock::time_point expand_start = get_time();
+                const EdgeIndex result = add_edges<Rules, SharedTree>(state, pool, node_index, allowed_count, config.rave ? allowed_count : 1, rng);
+                if constexpr (stats_enabled) {
+                    counters.expand_time += Clock::now() - expand_start;
+                }
+                return result;
+            };
+
+            // an untried move is taken before any tried one, as long as widening allows the node another
+            // if that is not possible right now, choose among the tried moves not proven to win or lose instead,
+            // and if they all are, try another move after all
+            // if nothing is left, simulate from this node
+            Node& node = pool.nodes[node_index];
+            const U32 empty_count = Rules::cell_count - state.ply;
+            const U32 allowed_count = get_allowed_edge_count(empty_count, load<SharedTree>(pool.node_visit_counts[node_index]), config);
+            EdgeIndex edge = invalid_edge_index;
+            if (load_edge_count<SharedTree>(node) < allowed_count) {
+                edge = try_add_edges(allowed_count);
+                // rave chooses among all the moves with uct and amaf rather than taking the first one added
+                if (config.rave) {
+                    edge = invalid_edge_index;
+                }
             }
-        } else {
-            assert(perspective == engine::Player::X);
 
-            if (state == engine::GameEnd::XWin) {
-                return 1.0;
+            if (edge == invalid_edge_index) {
+                const engine::CellIndex edge_count = load_edge_count<SharedTree>(node);
+                // an edge whose first visit is still on its way back is chosen by uct like the others, with its virtual loss
+                // counting as visits that scored nothing, or as unvisited and so first without virtual loss
+                if (edge_count > 0) {
+                    edge = select_edge_with_highest_uct<Rules, SharedTree>(pool, node_index, edge_count, config, rng);
+                }
+                if (edge == invalid_edge_index && edge_count < empty_count && allowed_count < empty_count) {
+                    edge = try_add_edges(empty_count);
+                }
+                if (edge == invalid_edge_index) {
+                    // every move of a node reached through a transposition can be proven by other move orders
+                    // while no iteration through the node itself proved it, so it is proven here before it is simulated
+                    if (load<SharedTree>(pool.node_proofs[node_index]) == Proof::None) {
+                        const Proof proof = prove<SharedTree>(pool, node_index, empty_count);
+                        if (proof != Proof::None) {
+                            store<SharedTree>(pool.node_proofs[node_index], proof);
+                        }
+                    }
+                    return;
+                }
+            }
+
+            const engine::CellIndex cell = pool.edge_cells[edge];
+            const U64 child_hash = hash ^ engine::get_zobrist_key<Rules>(state.next_turn, cell);
+            const NodeIndex child = get_child<SharedTree>(pool, edge, child_hash, other(state.next_turn));
+            if (child == invalid_node_index) {
+                return;
+            }
+
+            engine::play_move(state, cell);
+            assert(path.count <= Rules::cell_count);
+            path.edges[path.count - 1] = edge;
+            path.nodes[path.count] = child;
+            ++path.count;
+            fetch_add<SharedTree>(pool.edge_visit_counts[edge], virtual_loss);
+
+            // a finished game is proven as soon as it is reached, the player to move there has lost or drawn
+            if (state.game_end != engine::GameEnd::None) {
+                store<SharedTree>(pool.node_proofs[child], state.game_end == engine::GameEnd::Draw ? Proof::Draw : Proof::Loss);
+                return;
             }
 
-            if (state == engine::GameEnd::OWin) {
-                return 0.0;
+            // a position no move order has visited yet is a leaf, one reached before through a transposition
+            // already has statistics, so the search carries on below it unless it is proven
+            if (load<SharedTree>(pool.node_visit_counts[child]) == 0 || load<SharedTree>(pool.node_proofs[child]) != Proof::None) {
+                return;
             }
+
+            node_index = child;
+            hash = child_hash;
         }
+    }
+
+    // outcome of the rollouts run from one selected node
+    struct Rollouts {
+        U32 count;
+        U32 wins[2]; // indexed by Player
+    };
+
+    static void add(Rollouts& rollouts, engine::GameEnd result) {
+        assert(result != engine::GameEnd::None);
+        ++rollouts.count;
+        if (result == engine::GameEnd::OWin) {
+            ++rollouts.wins[static_cast<U8>(engine::Player::O)];
+        } else if (result == engine::GameEnd::XWin) {
+            ++rollouts.wins[static_cast<U8>(engine::Player::X)];
+        }
+    }
 
-        return 0.5;
+    static Score get_score(engine::Player perspective, const Rollouts& rollouts) {
+        const U32 wins = rollouts.wins[static_cast<U8>(perspective)];
+        const U32 losses = rollouts.wins[static_cast<U8>(other(perspective))];
+        const U32 draws = rollouts.count - wins - losses;
+        return 2 * wins + draws;
     }
 
-    static engine::GameEnd simulate(engine::Board& board) {
-        while (board.game_end == engine::GameEnd::None) {
-            engine::play_move(board, engine::get_random_move(board));
+    // a node proven to win or lose needs no rollouts, every one of them would end the same way
+    static Rollouts get_proven_rollouts(Proof proof, engine::Player player, U32 count) {
+        assert(proof == Proof::Win || proof == Proof::Loss);
+        Rollouts rollouts{count, {}};
+        rollouts.wins[static_cast<U8>(proof == Proof::Win ? player : other(player))] = count;
+        return rollouts;
+    }
+
+    template <typename Rules>
+    static engine::GameEnd simulate(engine::SearchState<Rules>& state, util::Rng& rng) {
+        while (state.game_end == engine::GameEnd::None) {
+            engine::play_move(state, engine::get_random_move(state, rng));
         }
 
-        return board.game_end;
+        return state.game_end;
     }
 
-    static void backprop(Node& node, engine::GameEnd result) {
-        ++node.visit_count;
-        if (node.parent) {
-            node.score += get_score(node.parent->perspective, result);
+    // leaf parallelism, several rollouts from the same node played in lockstep
+    template <typename Rules>
+    static Rollouts simulate(const engine::SearchState<Rules>& state, U32 count, util::Rng& rng, rollout::BatchRng& batch_rng, Counters& counters) {
+        Rollouts rollouts{};
+        if (count <= 1) {
+            engine::SearchState<Rules> rollout_state = state;
+            add(rollouts, simulate(rollout_state, rng));
+            if constexpr (stats_enabled) {
+                ++counters.rollout_count;
+                counters.rollout_move_count += rollout_state.ply - state.ply;
+            }
+            return rollouts;
         }
 
-        if (node.parent) {
-            backprop(*node.parent, result);
+        engine::GameEnd results[rollout::max_batch_size];
+        rollout::simulate_batch(state, count, batch_rng, results);
+        for (U32 i = 0; i < count; ++i) {
+            add(rollouts, results[i]);
         }
+
+        return rollouts;
     }
 
-    void generate_computer_moves(engine::Board& board) {
-        static constexpr U32 count = 100 * 1000;
+    // the cells each player holds at the end of every rollout of an iteration, and how the rollout ended, for rave
+    template <typename Rules>
+    struct Playouts {
+        typename Rules::Mask cells[rollout::max_batch_size][2]; // indexed by Player
+        engine::GameEnd results[rollout::max_batch_size];
+        U32 count;
+    };
 
-        if (board.game_end != engine::GameEnd::None) {
-            return;
+    // the simd batches do not return the boards their games end on, so rave plays its rollouts one at a time
+    template <typename Rules>
+    static Rollouts simulate(const engine::SearchState<Rules>& state, U32 count, util::Rng& rng, Counters& counters, Playouts<Rules>& playouts) {
+        Rollouts rollouts{};
+        playouts.count = count;
+        for (U32 i = 0; i < playouts.count; ++i) {
+            engine::SearchState<Rules> rollout_state = state;
+            const engine::GameEnd result = simulate(rollout_state, rng);
+            add(rollouts, result);
+            playouts.cells[i][static_cast<U8>(engine::Player::O)] = rollout_state.cells[static_cast<U8>(engine::Player::O)];
+            playouts.cells[i][static_cast<U8>(engine::Player::X)] = rollout_state.cells[static_cast<U8>(engine::Player::X)];
+            playouts.results[i] = result;
+            if constexpr (stats_enabled) {
+                ++counters.rollout_count;
+                counters.rollout_move_count += rollout_state.ply - state.ply;
+            }
         }
 
-        engine::Board board_copy;
-        memcpy(&board_copy, &board, sizeof(board));
+        return rollouts;
+    }
 
-        Node root_node{};
-        root_node.perspective = board.next_turn;
+    static Score get_score(engine::Player perspective, engine::GameEnd result) {
+        Rollouts rollouts{};
+        add(rollouts, result);
+        return get_score(perspective, rollouts);
+    }
 
-        for (U32 i = 0; i < count; ++i) {
-            Node& node = select(board, root_node);
-            const engine::GameEnd result = simulate(board);
-            backprop(node, result);
-            memcpy(&board, &board_copy, sizeof(board));
+    // all moves as first, a move of a node on the path is scored as if it had been played at once whenever its mover
+    // went on to play it later in the iteration, in the tree or in a rollout
+    // the move's cell is empty at its node, so the mover played it later exactly when the mover holds it at the end
+    template <typename Rules, bool SharedTree>
+    static void update_amaf(NodePool& pool, const Path<Rules>& path, const Playouts<Rules>& playouts) {
+        for (engine::CellIndex i = 0; i < path.count; ++i) {
+            Node& node = pool.nodes[path.nodes[i]];
+            const engine::Player mover = node.perspective;
+            for_each_edge(pool, node, load_edge_count<SharedTree>(node), [&](EdgeIndex edge, engine::CellIndex) {
+                const engine::CellIndex cell = pool.edge_cells[edge];
+                U32 visit_count = 0;
+                Score score = 0;
+                for (U32 j = 0; j < playouts.count; ++j) {
+                    if (engine::has_cell(playouts.cells[j][static_cast<U8>(mover)], cell)) {
+                        ++visit_count;
+                        score += get_score(mover, playouts.results[j]);
+                    }
+                }
+
+                if (visit_count > 0) {
+                    fetch_add<SharedTree>(pool.edge_amaf_visit_counts[edge], visit_count);
+                    fetch_add<SharedTree>(pool.edge_amaf_scores[edge], score);
+                }
+            });
         }
+    }
 
-        for (U32 i = 0; i < count; ++i) {
-            Node& node = select(board, root_node);
-            const engine::GameEnd result = simulate(board);
-            backprop(node, result);
-            memcpy(&board, &board_copy, sizeof(board));
-
-            const Node* result_node = select_child_with_highest_value<SelectChildHandleWithHighestValue_CollisionResolutionStrategy::None>(root_node, [](const Node& a, const Node& b) {
-                const double result = b.visit_count - a.visit_count;
-                if (result == 0) {
-                    assert(a.visit_count == b.visit_count);
-                    if (a.visit_count != 0) {
-                        assert(a.visit_count != 0);
-                        const double result_2 = b.score - a.score;
-                        return (result_2 < 0) ? -1 : (result_2 > 0) ? 1 : 0;
+    // root_empty_count is the number of empty cells at the root, so the node after i moves has i fewer
+    template <typename Rules, bool SharedTree>
+    static void backprop(NodePool& pool, const Path<Rules>& path, const Rollouts& rollouts, U32 virtual_loss, U32 root_empty_count) {
+        for (engine::CellIndex i = 0; i + 1 < path.count; ++i) {
+            const EdgeIndex edge = path.edges[i];
+            // an edge's score is from the perspective of the player who makes its move
+            const engine::Player mover = pool.nodes[path.nodes[i]].perspective;
+
+            // select added the virtual loss on the way down, replace it with the real visits
+            fetch_add<SharedTree>(pool.edge_visit_counts[edge], rollouts.count - virtual_loss);
+            fetch_add<SharedTree>(pool.edge_scores[edge], get_score(mover, rollouts));
+        }
+
+        for (engine::CellIndex i = 0; i < path.count; ++i) {
+            fetch_add<SharedTree>(pool.node_visit_counts[path.nodes[i]], rollouts.count);
+        }
+
+        // a proof can only have changed on the path, and only above a node that is proven
+        for (engine::CellIndex i = path.count - 1; i > 0; --i) {
+            const NodeIndex parent = path.nodes[i - 1];
+            if (load<SharedTree>(pool.node_proofs[path.nodes[i]]) == Proof::None || load<SharedTree>(pool.node_proofs[parent]) != Proof::None) {
+                break;
+            }
+
+            const Proof proof = prove<SharedTree>(pool, parent, root_empty_count - (i - 1));
+            if (proof == Proof::None) {
+                break;
+            }
+            store<SharedTree>(pool.node_proofs[parent], proof);
+        }
+    }
+
+    static int compare_visits_then_score(U32 a_visit_count, Score a_score, U32 b_visit_count, Score b_score) {
+        if (a_visit_count == b_visit_count) {
+            if (a_visit_count != 0) {
+                return (b_score < a_score) ? -1 : (b_score > a_score) ? 1 : 0;
+            }
+
+            return 0;
+        }
+
+        return (b_visit_count < a_visit_count) ? -1 : 1;
+    }
+
+    // statistics of the moves the root tried, in the order it first tried them
+    template <typename Rules>
+    struct RootResult {
+        engine::CellIndex cells[Rules::cell_count];
+        U32 visit_counts[Rules::cell_count];
+        Score scores[Rules::cell_count];
+        Proof proofs[Rules::cell_count]; // for the player making the move
+        engine::CellIndex children_count;
+        Proof proof; // of the root
+    };
+
+    // 3^cell_count, every cell is empty, O or X, saturating for boards too big to count
+    template <typename Rules>
+    static constexpr U32 position_limit = [] {
+        U64 result = 1;
+        for (U32 i = 0; i < Rules::cell_count && result < invalid_node_index; ++i) {
+            result *= 3;
+        }
+        return result < invalid_node_index ? static_cast<U32>(result) : invalid_node_index - 1;
+    }();
+
+    // the dag of one search and its root
+    struct Tree {
+        NodePool pool;
+        NodeIndex root;
+    };
+
+    // an iteration creates at most one node, and usually adds one edge
+    // kept_count is the nodes a reused tree brings along, the search still gets room for its own iterations on top of them
+    template <typename Rules>
+    static U32 get_node_capacity(const Config& config, U32 kept_count = 0) {
+        const U64 iteration_limit = 1 + 2 * static_cast<U64>(config.max_iterations) + kept_count;
+        U32 result = util::min(position_limit<Rules>, config.max_nodes);
+        return iteration_limit < result ? static_cast<U32>(iteration_limit) : result;
+    }
+
+    // a node with edges wastes at most a block less one edge, so two blocks a node leave room for about one edge a node
+    // on top of that, when the pool runs out nodes simply stop trying new moves
+    // rave gives a node all its moves at once, so it gets room for all of them
+    template <typename Rules>
+    static U32 get_edge_capacity(U32 node_capacity, const Config& config) {
+        const U32 move_block_count = (Rules::cell_count + edge_block_size - 1) / edge_block_size;
+        const U32 block_count = config.rave ? move_block_count : util::min(move_block_count, 2);
+        const U64 result = static_cast<U64>(node_capacity) * block_count * edge_block_size;
+        return result < max_edge_count ? static_cast<U32>(result) : max_edge_count;
+    }
+
+    template <typename Rules>
+    static NodeIndex create_root(NodePool& pool, const engine::SearchState<Rules>& root_state, const Config& config) {
+        const U32 node_capacity = get_node_capacity<Rules>(config);
+        init(pool, node_capacity, get_edge_capacity<Rules>(node_capacity, config), config.rave);
+        const NodeIndex root_index = allocate<false>(pool.node_count, pool.node_capacity, 1);
+        Node& root_node = pool.nodes[root_index];
+        root_node.hash = engine::get_hash(root_state);
+        root_node.first_edge = invalid_edge_index;
+        root_node.edge_count = 0;
+        root_node.expansion = Expansion::None;
+        root_node.perspective = root_state.next_turn;
+        pool.node_visit_counts[root_index] = 0;
+        pool.node_proofs[root_index] = Proof::None;
+        insert<false>(pool, root_index);
+        return root_index;
+    }
+
+    // copies the part of the dag reachable from new_root into a new pool, the old pool and everything else in it is freed
+    // nodes are copied closest to the root first, if the new capacity is smaller the deepest ones are left out
+    // and created again when their moves are next played
+    static void promote(Tree& tree, NodeIndex new_root, U32 node_capacity, U32 edge_capacity) {
+        const NodePool& old_pool = tree.pool;
+        NodePool pool;
+        init(pool, node_capacity, edge_capacity, old_pool.edge_amaf_visit_counts != nullptr);
+
+        std::vector<NodeIndex> new_indices(get_allocated_count(old_pool), invalid_node_index);
+        std::vector<NodeIndex> queue;
+        new_indices[new_root] = allocate<false>(pool.node_count, pool.node_capacity, 1);
+        queue.push_back(new_root);
+        for (U32 next = 0; next < queue.size(); ++next) {
+            const NodeIndex old_index = queue[next];
+            const NodeIndex node_index = new_indices[old_index];
+            const Node& old_node = old_pool.nodes[old_index];
+            Node& node = pool.nodes[node_index];
+            node = old_node;
+            node.first_edge = invalid_edge_index;
+            node.edge_count = 0;
+            pool.node_visit_counts[node_index] = old_pool.node_visit_counts[old_index];
+            pool.node_proofs[node_index] = old_pool.node_proofs[old_index];
+
+            // once the edge pool is full the moves not copied count as untried again
+            EdgeIndex block = invalid_edge_index;
+            for_each_edge(old_pool, old_node, old_node.edge_count, [&](EdgeIndex old_edge, engine::CellIndex i) {
+                if (node.edge_count != i) {
+                    return;
+                }
+
+                if (i % edge_block_size == 0) {
+                    const EdgeIndex new_block = allocate<false>(pool.edge_count, pool.edge_capacity, edge_block_size);
+                    if (new_block == invalid_edge_index) {
+                        return;
                     }
 
-                    return 0;
+                    pool.edge_next_blocks[new_block / edge_block_size] = invalid_edge_index;
+                    if (i == 0) {
+                        node.first_edge = new_block;
+                    } else {
+                        pool.edge_next_blocks[block / edge_block_size] = new_block;
+                    }
+                    block = new_block;
+                }
+
+                const EdgeIndex edge = block + i % edge_block_size;
+                pool.edge_cells[edge] = old_pool.edge_cells[old_edge];
+                pool.edge_visit_counts[edge] = old_pool.edge_visit_counts[old_edge];
+                pool.edge_scores[edge] = old_pool.edge_scores[old_edge];
+                if (pool.edge_amaf_visit_counts) {
+                    pool.edge_amaf_visit_counts[edge] = old_pool.edge_amaf_visit_counts[old_edge];
+                    pool.edge_amaf_scores[edge] = old_pool.edge_amaf_scores[old_edge];
                 }
 
-                return (result < 0) ? -1 : 1;
+                const NodeIndex old_child = old_pool.edge_children[old_edge];
+                if (old_child != invalid_node_index && new_indices[old_child] == invalid_node_index) {
+                    new_indices[old_child] = allocate<false>(pool.node_count, pool.node_capacity, 1);
+                    if (new_indices[old_child] != invalid_node_index) {
+                        queue.push_back(old_child);
+                    }
+                }
+                pool.edge_children[edge] = old_child == invalid_node_index ? invalid_node_index : new_indices[old_child];
+                ++node.edge_count;
             });
 
-            if (result_node) {
-                board.ai_best_moves_count = 1;
-                board.ai_best_moves[0] = result_node->coord;
+            insert<false>(pool, node_index);
+        }
+
+        tree.pool = std::move(pool);
+        tree.root = new_indices[new_root];
+    }
+
+    // makes the position the root of the tree, keeping the statistics below it if the tree has already been there
+    // a tree grown without amaf statistics cannot be searched with rave or the other way around, so it starts over
+    // the pool is only kept as it is while it has room for the whole budget and is no bigger than max_nodes allows
+    template <typename Rules>
+    static void set_root(Tree& tree, const engine::SearchState<Rules>& root_state, const Config& config) {
+        if (tree.pool.nodes && (tree.pool.edge_amaf_visit_counts != nullptr) == config.rave) {
+            const NodeIndex node_index = find<false>(tree.pool, engine::get_hash(root_state));
+            const U32 node_capacity = get_node_capacity<Rules>(config, get_allocated_count(tree.pool));
+            if (node_index == tree.root && tree.pool.node_capacity >= node_capacity && tree.pool.node_capacity <= config.max_nodes) {
+                return;
+            }
+
+            if (node_index != invalid_node_index) {
+                promote(tree, node_index, node_capacity, get_edge_capacity<Rules>(node_capacity, config));
                 return;
             }
         }
 
-        assert(root_node.children_count > 0);
+        tree.root = create_root(tree.pool, root_state, config);
+    }
 
-        board.ai_best_moves_count = children_with_highest_value<engine::Coordinate>(root_node, board.ai_best_moves, [](const Node& a, const Node& b) {
-            const double result = b.visit_count - a.visit_count;
-            if (result == 0) {
-                assert(a.visit_count == b.visit_count);
-                if (a.visit_count != 0) {
-                    assert(a.visit_count != 0);
-                    const double result_2 = b.score - a.score;
-                    return (result_2 < 0) ? -1 : (result_2 > 0) ? 1 : 0;
+    template <typename Rules, bool SharedTree>
+    static void iterate(const engine::SearchState<Rules>& root_state, NodePool& pool, NodeIndex root_index, const Config& config, util::Rng& rng, rollout::BatchRng& batch_rng, Counters& counters) {
+        const U32 virtual_loss = SharedTree ? config.virtual_loss : 0;
+        engine::SearchState<Rules> state = root_state;
+        Path<Rules> path;
+        const Clock::time_point select_start = get_time();
+        select<Rules, SharedTree>(state, pool, root_index, config, virtual_loss, rng, path, counters);
+        const Clock::time_point simulate_start = get_time();
+        // a proven draw still plays its rollouts, scoring it exactly would make it look better than the moves
+        // that are still scored by random games, which underrate a win that needs precise play
+        // a proven leaf plays no rollouts, so it leaves amaf as it is
+        const NodeIndex leaf = path.nodes[path.count - 1];
+        const Proof proof = load<SharedTree>(pool.node_proofs[leaf]);
+        Playouts<Rules> playouts;
+        playouts.count = 0;
+        Rollouts rollouts;
+        if (proof == Proof::Win || proof == Proof::Loss) {
+            rollouts = get_proven_rollouts(proof, pool.nodes[leaf].perspective, config.rollouts_per_leaf);
+        } else if (config.rave) {
+            rollouts = simulate(state, config.rollouts_per_leaf, rng, counters, playouts);
+        } else {
+            rollouts = simulate(state, config.rollouts_per_leaf, rng, batch_rng, counters);
+        }
+
+        const Clock::time_point backprop_start = get_time();
+        backprop<Rules, SharedTree>(pool, path, rollouts, virtual_loss, Rules::cell_count - root_state.ply);
+        if (playouts.count > 0) {
+            update_amaf<Rules, SharedTree>(pool, path, playouts);
+        }
+
+        ++counters.iteration_count;
+        if constexpr (stats_enabled) {
+            const Clock::time_point end = Clock::now();
+            counters.select_time += simulate_start - select_start;
+            counters.simulate_time += backprop_start - simulate_start;
+            counters.backprop_time += end - backprop_start;
+            counters.max_depth = util::max(counters.max_depth, path.count - 1u);
+        }
+    }
+
+    template <typename Rules, bool SharedTree>
+    static void get_root_result(NodePool& pool, NodeIndex root_index, RootResult<Rules>& root_result) {
+        Node& root_node = pool.nodes[root_index];
+        root_result.children_count = load_edge_count<SharedTree>(root_node);
+        for_each_edge(pool, root_node, root_result.children_count, [&](EdgeIndex edge, engine::CellIndex i) {
+            root_result.cells[i] = pool.edge_cells[edge];
+            root_result.visit_counts[i] = load<SharedTree>(pool.edge_visit_counts[edge]);
+            root_result.scores[i] = load<SharedTree>(pool.edge_scores[edge]);
+            root_result.proofs[i] = flip(get_child_proof<SharedTree>(pool, edge));
+        });
+        root_result.proof = load<SharedTree>(pool.node_proofs[root_index]);
+    }
+
+    // the move with the most visits is played, so once its lead over the next one is more than the visits left
+    // in the budget it cannot be overtaken and searching on would not change the move
+    // an untried move has no visits, so it counts as a next one with none
+    // a move proven to lose is never played while another one is left, as best_moves ranks by proof first,
+    // so its visits are no lead
+    template <bool SharedTree>
+    static bool is_decided(NodePool& pool, NodeIndex root_index, U64 remaining_visit_count) {
+        Node& root_node = pool.nodes[root_index];
+        U32 most = 0;
+        U32 second = 0;
+        for_each_edge(pool, root_node, load_edge_count<SharedTree>(root_node), [&](EdgeIndex edge, engine::CellIndex) {
+            if (get_child_proof<SharedTree>(pool, edge) == Proof::Win) {
+                return;
+            }
+
+            const U32 visit_count = load<SharedTree>(pool.edge_visit_counts[edge]);
+            if (visit_count > most) {
+                second = most;
+                most = visit_count;
+            } else if (visit_count > second) {
+                second = visit_count;
+            }
+        });
+
+        return most - second > remaining_visit_count;
+    }
+
+    // the clock and the root are only looked at every so many iterations, so the checks cost next to nothing
+    static constexpr U32 check_interval = 256;
+
+    // no node can get the block of edges for its next move, so the tree can hardly grow any more
+    template <bool SharedTree>
+    static bool is_edge_pool_full(NodePool& pool) {
+        return pool.edge_capacity - load<SharedTree>(pool.edge_count) < edge_block_size;
+    }
+
+    // whether the search should stop after iteration, counted from the start of this search
+    template <bool SharedTree>
+    static bool is_budget_spent(NodePool& pool, NodeIndex root_index, const Config& config, U32 iteration, Clock::time_point start) {
+        if (iteration + 1 >= config.max_iterations || load<SharedTree>(pool.node_count) >= pool.node_capacity) {
+            return true;
+        }
+        if (is_edge_pool_full<SharedTree>(pool)) {
+            return true;
+        }
+
+        U64 remaining_iteration_count = config.max_iterations - (iteration + 1);
+        if (config.deadline != Clock::time_point::max()) {
+            const Clock::time_point now = Clock::now();
+            if (now >= config.deadline) {
+                return true;
+            }
+
+            // assumes the rest of the search runs at the speed it has had so far
+            const double elapsed = std::chrono::duration<double>(now - start).count();
+            const double left = std::chrono::duration<double>(config.deadline - now).count();
+            if (elapsed > 0.0) {
+                const double time_limit = static_cast<double>(iteration + 1) * left / elapsed;
+                if (time_limit < static_cast<double>(remaining_iteration_count)) {
+                    remaining_iteration_count = static_cast<U64>(time_limit);
                 }
+            }
+        }
+
+        return is_decided<SharedTree>(pool, root_index, remaining_iteration_count * config.rollouts_per_leaf);
+    }
+
+    // hands the root statistics to the thread waiting on an async search, and tells the search whether to stop
+    // async is null for a search that nobody waits on, and publishes is false for all but one tree of root parallelism
+    template <typename Rules, bool SharedTree>
+    static bool report(AsyncSearch<Rules>* async, bool publishes, NodePool& pool, NodeIndex root_index, U32 iteration) {
+        if (!async) {
+            return false;
+        }
+
+        if (publishes) {
+            Node& root_node = pool.nodes[root_index];
+            const engine::CellIndex edge_count = load_edge_count<SharedTree>(root_node);
+            const std::lock_guard<std::mutex> lock(async->mutex);
+            async->progress.move_count = edge_count;
+            for_each_edge(pool, root_node, edge_count, [&](EdgeIndex edge, engine::CellIndex i) {
+                async->progress.cells[i] = pool.edge_cells[edge];
+                async->progress.visit_counts[i] = load<SharedTree>(pool.edge_visit_counts[edge]);
+            });
+            async->progress.iteration_count = iteration + 1;
+        }
+
+        return async->cancelled.load(std::memory_order_relaxed);
+    }
 
-                return 0;
+    template <typename Rules>
+    static void search(Tree& tree, const engine::SearchState<Rules>& root_state, const Config& config, util::Rng& rng, AsyncSearch<Rules>* async, bool publishes, RootResult<Rules>& root_result, Counters& counters) {
+        const Clock::time_point start = Clock::now();
+        set_root(tree, root_state, config);
+        NodePool& pool = tree.pool;
+        const NodeIndex root_index = tree.root;
+        const U32 first_node_count = get_allocated_count(pool);
+        const U32 first_visit_count = pool.node_visit_counts[root_index];
+        rollout::BatchRng batch_rng = rollout::make_batch_rng(rng);
+
+        for (U32 i = 0; i < config.max_iterations; ++i) {
+            iterate<Rules, false>(root_state, pool, root_index, config, rng, batch_rng, counters);
+            // the best move of a proven root is known exactly
+            if (pool.node_proofs[root_index] != Proof::None) {
+                break;
+            }
+            if ((i + 1) % check_interval == 0) {
+                if (report<Rules, false>(async, publishes, pool, root_index, i) || is_budget_spent<false>(pool, root_index, config, i, start)) {
+                    break;
+                }
             }
+        }
+
+        assert(pool.nodes[root_index].edge_count > 0);
+        get_root_result<Rules, false>(pool, root_index, root_result);
+        counters.node_count = get_allocated_count(pool) - first_node_count;
+        counters.reused_visit_count = first_visit_count;
+        counters.new_visit_count = pool.node_visit_counts[root_index] - first_visit_count;
+        counters.edges_exhausted = is_edge_pool_full<false>(pool);
+    }
+
+    // the search keeps its threads while the thread count stays the same
+    template <typename Rules>
+    static thread_pool::ThreadPool& get_thread_pool(Search<Rules>& search, U32 thread_count) {
+        if (!search.threads || thread_pool::thread_count(*search.threads) != thread_count) {
+            search.threads.reset();
+            search.threads = std::make_unique<thread_pool::ThreadPool>(thread_count);
+        }
+
+        return *search.threads;
+    }
+
+    // tree parallelism, every thread works on the same tree and they share out the iterations
+    template <typename Rules>
+    static void search_shared(Tree& tree, thread_pool::ThreadPool& threads, const engine::SearchState<Rules>& root_state, const Config& config, util::Rng& rng, AsyncSearch<Rules>* async, RootResult<Rules>& root_result, std::vector<Counters>& counters) {
+        const Clock::time_point start = Clock::now();
+        set_root(tree, root_state, config);
+        NodePool& pool = tree.pool;
+        const NodeIndex root_index = tree.root;
+        const U32 first_node_count = get_allocated_count(pool);
+        const U32 first_visit_count = pool.node_visit_counts[root_index];
+
+        std::vector<util::Rng> rngs(config.thread_count);
+        std::vector<rollout::BatchRng> batch_rngs(config.thread_count);
+        for (U32 i = 0; i < config.thread_count; ++i) {
+            rngs[i] = util::make_rng(util::next_u64(rng));
+            batch_rngs[i] = rollout::make_batch_rng(rng);
+        }
+
+        U32 next_iteration = 0;
+        bool stop = false;
+        thread_pool::run(threads, config.thread_count, [&](U32 thread_index) {
+            while (!std::atomic_ref<bool>(stop).load(std::memory_order_relaxed)) {
+                const U32 iteration = std::atomic_ref<U32>(next_iteration).fetch_add(1, std::memory_order_relaxed);
+                if (iteration >= config.max_iterations) {
+                    break;
+                }
 
-            return (result < 0) ? -1 : 1;
-        }, [](Node& child) {
-            return child.coord;
+                iterate<Rules, true>(root_state, pool, root_index, config, rngs[thread_index], batch_rngs[thread_index], counters[thread_index]);
+                if (load<true>(pool.node_proofs[root_index]) != Proof::None) {
+                    std::atomic_ref<bool>(stop).store(true, std::memory_order_relaxed);
+                    break;
+                }
+                if ((iteration + 1) % check_interval == 0) {
+                    if (report<Rules, true>(async, true, pool, root_index, iteration) || is_budget_spent<true>(pool, root_index, config, iteration, start)) {
+                        std::atomic_ref<bool>(stop).store(true, std::memory_order_relaxed);
+                    }
+                }
+            }
         });
 
+        // run has joined every thread, so the tree can be read directly again
+        assert(pool.nodes[root_index].edge_count > 0);
+        get_root_result<Rules, false>(pool, root_index, root_result);
+        counters[0].node_count = get_allocated_count(pool) - first_node_count;
+        counters[0].reused_visit_count = first_visit_count;
+        counters[0].new_visit_count = pool.node_visit_counts[root_index] - first_visit_count;
+        counters[0].edges_exhausted = is_edge_pool_full<false>(pool);
+    }
+
+    // every tree tries the root's moves in its own random order, and may not try all of them, so moves are matched by cell
+    template <typename Rules>
+    static void merge(RootResult<Rules>& result, const RootResult<Rules>& other) {
+        engine::CellIndex indices[Rules::cell_count]; // of the move in result, cell_count if result has not tried it
+        std::fill_n(indices, Rules::cell_count, static_cast<engine::CellIndex>(Rules::cell_count));
+        for (engine::CellIndex i = 0; i < result.children_count; ++i) {
+            indices[result.cells[i]] = i;
+        }
+
+        for (engine::CellIndex i = 0; i < other.children_count; ++i) {
+            engine::CellIndex index = indices[other.cells[i]];
+            if (index == Rules::cell_count) {
+                index = result.children_count;
+                result.cells[index] = other.cells[i];
+                result.visit_counts[index] = 0;
+                result.scores[index] = 0;
+                result.proofs[index] = Proof::None;
+                ++result.children_count;
+            }
+            result.visit_counts[index] += other.visit_counts[i];
+            result.scores[index] += other.scores[i];
+            // proofs are exact, so the trees that have one agree on it
+            if (result.proofs[index] == Proof::None) {
+                result.proofs[index] = other.proofs[i];
+            }
+        }
+
+        if (result.proof == Proof::None) {
+            result.proof = other.proof;
+        }
+    }
+
+    // a proven win is played over any move still being searched, and a proven loss only if every move is one
+    static U32 get_rank(Proof proof) {
+        return proof == Proof::Win ? 2 : proof == Proof::Loss ? 0 : 1;
+    }
+
+    template <typename Rules>
+    static engine::CellIndex best_moves(const RootResult<Rules>& root_result, engine::Coordinate result[]) {
+        assert(root_result.children_count > 0);
+
+        engine::CellIndex highest_count = 1;
+        engine::CellIndex highest_indices[Rules::cell_count];
+        highest_indices[0] = 0;
+
+        for (engine::CellIndex i = 1; i < root_result.children_count; ++i) {
+            const engine::CellIndex highest = highest_indices[0];
+            const U32 highest_rank = get_rank(root_result.proofs[highest]);
+            const U32 rank = get_rank(root_result.proofs[i]);
+            const int compare_result = highest_rank != rank ? (rank > highest_rank ? 1 : -1) : compare_visits_then_score(
+                root_result.visit_counts[highest], root_result.scores[highest],
+                root_result.visit_counts[i], root_result.scores[i]);
+            if (compare_result > 0) {
+                highest_count = 1;
+                highest_indices[0] = i;
+            } else if (compare_result == 0) {
+                highest_indices[highest_count] = i;
+                ++highest_count;
+            }
+        }
+
+        for (engine::CellIndex i = 0; i < highest_count; ++i) {
+            result[i] = engine::get_coordinate<Rules>(root_result.cells[highest_indices[i]]);
+        }
+
+        return highest_count;
+    }
+
+    template <typename Rules>
+    Search<Rules>::Search() : thread_count(0), parallelism(Parallelism::Root) {
+    }
+
+    template <typename Rules>
+    Search<Rules>::~Search() = default;
+
+    static double get_seconds(Clock::duration duration) {
+        return std::chrono::duration<double>(duration).count();
+    }
+
+    template <typename Rules>
+    static void add(Stats<Rules>& stats, const Counters& counters) {
+        stats.iteration_count += counters.iteration_count;
+        stats.node_count += counters.node_count;
+        stats.reused_visit_count += counters.reused_visit_count;
+        stats.new_visit_count += counters.new_visit_count;
+        stats.edges_exhausted = stats.edges_exhausted || counters.edges_exhausted;
+        stats.select_seconds += get_seconds(counters.select_time - counters.expand_time);
+        stats.expand_seconds += get_seconds(counters.expand_time);
+        stats.simulate_seconds += get_seconds(counters.simulate_time);
+        stats.backprop_seconds += get_seconds(counters.backprop_time);
+        stats.max_depth = util::max(stats.max_depth, counters.max_depth);
+        stats.rollout_count += counters.rollout_count;
+        stats.rollout_move_count += counters.rollout_move_count;
+    }
+
+    // the counts of a config are clamped to what the search can run once, before anything reads them,
+    // so a search always runs at least one iteration on at least one thread and a batch never outgrows its buffers
+    static Config get_valid_config(const Config& config) {
+        Config result = config;
+        result.thread_count = util::max(config.thread_count, 1);
+        result.rollouts_per_leaf = util::min(util::max(config.rollouts_per_leaf, 1), rollout::max_batch_size);
+        result.max_iterations = util::max(config.max_iterations, 1);
+        result.max_nodes = util::max(config.max_nodes, 1);
+        return result;
+    }
+
+    template <typename Rules>
+    static Stats<Rules> run(Search<Rules>& search, engine::Board<Rules>& board, util::Rng& rng, const Config& requested_config, AsyncSearch<Rules>* async) {
+        Stats<Rules> stats{};
+        if (board.state.game_end != engine::GameEnd::None) {
+            return stats;
+        }
+
+        const Clock::time_point start = Clock::now();
+        const Config config = get_valid_config(requested_config);
+        const U32 tree_count = config.parallelism == Parallelism::Root ? config.thread_count : 1;
+        // trees of a different split of the work do not line up with the new one
+        if (search.trees.size() != tree_count || search.thread_count != config.thread_count || search.parallelism != config.parallelism) {
+            search.trees.clear();
+            search.trees.resize(tree_count);
+            search.thread_count = config.thread_count;
+            search.parallelism = config.parallelism;
+        }
+
+        std::vector<RootResult<Rules>> results(tree_count);
+        // one per thread, each only ever touched by its own thread
+        std::vector<Counters> counters(config.thread_count);
+        if (config.parallelism == Parallelism::Tree && config.thread_count > 1) {
+            search_shared(search.trees[0], get_thread_pool(search, config.thread_count), board.state, config, rng, async, results[0], counters);
+        } else if (tree_count == 1) {
+            mcts::search(search.trees[0], board.state, config, rng, async, true, results[0], counters[0]);
+        } else {
+            // root parallelism, every thread grows its own tree from its own random sequence
+            std::vector<util::Rng> rngs(tree_count);
+            for (util::Rng& tree_rng : rngs) {
+                tree_rng = util::make_rng(util::next_u64(rng));
+            }
+
+            thread_pool::run(get_thread_pool(search, tree_count), tree_count, [&search, &board, &config, async, &results, &rngs, &counters](U32 i) {
+                mcts::search(search.trees[i], board.state, config, rngs[i], async, i == 0, results[i], counters[i]);
+            });
+
+            for (U32 i = 1; i < tree_count; ++i) {
+                merge(results[0], results[i]);
+            }
+        }
+
+        board.ai_best_moves_count = best_moves(results[0], board.ai_best_moves);
         assert(board.ai_best_moves_count > 0);
+
+        for (const Counters& thread_counters : counters) {
+            add(stats, thread_counters);
+        }
+        stats.seconds = get_seconds(Clock::now() - start);
+        stats.move_count = results[0].children_count;
+        stats.proof = results[0].proof;
+        for (engine::CellIndex i = 0; i < results[0].children_count; ++i) {
+            stats.cells[i] = results[0].cells[i];
+            stats.visit_counts[i] = results[0].visit_counts[i];
+        }
+        return stats;
+    }
+
+    template <typename Rules>
+    Stats<Rules> generate_computer_moves(Search<Rules>& search, engine::Board<Rules>& board, util::Rng& rng, const Config& config) {
+        return run(search, board, rng, config, static_cast<AsyncSearch<Rules>*>(nullptr));
+    }
+
+    template <typename Rules>
+    Stats<Rules> generate_computer_moves(engine::Board<Rules>& board, util::Rng& rng, const Config& config) {
+        Search<Rules> search;
+        return generate_computer_moves(search, board, rng, config);
+    }
+
+    template <typename Rules>
+    MemoryUsage get_memory_usage(const Search<Rules>& search) {
+        static constexpr U64 node_bytes = sizeof(Node) + sizeof(U32) + sizeof(Proof);
+        static constexpr U64 edge_bytes = sizeof(EdgeCell) + sizeof(NodeIndex) + sizeof(U32) + sizeof(Score);
+        static constexpr U64 amaf_bytes = sizeof(U32) + sizeof(Score);
+        MemoryUsage result{};
+        for (const Tree& tree : search.trees) {
+            const NodePool& pool = tree.pool;
+            // the table is filled with invalid_node_index when allocated, so all of it is in use
+            const U64 table_bytes = pool.transpositions.entries ? (static_cast<U64>(pool.transpositions.bucket_mask) + 1) * bucket_size * sizeof(NodeIndex) : 0;
+            const U64 block_bytes = edge_block_size * (edge_bytes + (pool.edge_amaf_visit_counts ? amaf_bytes : 0)) + sizeof(EdgeIndex);
+            result.allocated_bytes += pool.node_capacity * node_bytes + pool.edge_capacity / edge_block_size * block_bytes + table_bytes;
+            result.used_bytes += get_allocated_count(pool) * node_bytes + pool.edge_count / edge_block_size * block_bytes + table_bytes;
+        }
+        return result;
+    }
+
+    template <typename Rules>
+    AsyncSearch<Rules>::AsyncSearch() : cancelled(false), finished(false), progress{}, board{}, stats{}, rng{} {
+    }
+
+    template <typename Rules>
+    AsyncSearch<Rules>::~AsyncSearch() {
+        cancel(*this);
+    }
+
+    template <typename Rules>
+    void start(AsyncSearch<Rules>& async, Search<Rules>& search, const engine::Board<Rules>& board, util::Rng& rng, const Config& config) {
+        cancel(async);
+        async.cancelled.store(false, std::memory_order_relaxed);
+        async.finished.store(false, std::memory_order_relaxed);
+        async.progress = Progress<Rules>{};
+        async.board = board;
+        async.rng = util::make_rng(util::next_u64(rng));
+        async.thread = std::thread([&async, &search, config] {
+            async.stats = run(search, async.board, async.rng, config, &async);
+            // publishes the best moves in async.board and the stats to poll
+            async.finished.store(true, std::memory_order_release);
+        });
+    }
+
+    template <typename Rules>
+    bool is_running(const AsyncSearch<Rules>& async) {
+        return async.thread.joinable();
+    }
+
+    template <typename Rules>
+    bool poll(AsyncSearch<Rules>& async, Progress<Rules>& progress) {
+        if (!is_running(async)) {
+            return false;
+        }
+
+        {
+            const std::lock_guard<std::mutex> lock(async.mutex);
+            progress = async.progress;
+        }
+
+        if (!async.finished.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        async.thread.join();
+        return true;
     }
+
+    template <typename Rules>
+    void cancel(AsyncSearch<Rules>& async) {
+        if (is_running(async)) {
+            async.cancelled.store(true, std::memory_order_relaxed);
+            async.thread.join();
+        }
+    }
+
+    template struct Search<engine::TicTacToe>;
+    template struct Search<engine::ConnectFive>;
+    template struct Search<engine::Gomoku>;
+
+    template struct AsyncSearch<engine::TicTacToe>;
+    template struct AsyncSearch<engine::ConnectFive>;
+    template struct AsyncSearch<engine::Gomoku>;
+
+    template Stats<engine::TicTacToe> generate_computer_moves(Search<engine::TicTacToe>& search, engine::Board<engine::TicTacToe>& board, util::Rng& rng, const Config& config);
+    template Stats<engine::ConnectFive> generate_computer_moves(Search<engine::ConnectFive>& search, engine::Board<engine::ConnectFive>& board, util::Rng& rng, const Config& config);
+    template Stats<engine::Gomoku> generate_computer_moves(Search<engine::Gomoku>& search, engine::Board<engine::Gomoku>& board, util::Rng& rng, const Config& config);
+
+    template Stats<engine::TicTacToe> generate_computer_moves(engine::Board<engine::TicTacToe>& board, util::Rng& rng, const Config& config);
+    template Stats<engine::ConnectFive> generate_computer_moves(engine::Board<engine::ConnectFive>& board, util::Rng& rng, const Config& config);
+    template Stats<engine::Gomoku> generate_computer_moves(engine::Board<engine::Gomoku>& board, util::Rng& rng, const Config& config);
+
+    template MemoryUsage get_memory_usage(const Search<engine::TicTacToe>& search);
+    template MemoryUsage get_memory_usage(const Search<engine::ConnectFive>& search);
+    template MemoryUsage get_memory_usage(const Search<engine::Gomoku>& search);
+
+    template void start(AsyncSearch<engine::TicTacToe>& async, Search<engine::TicTacToe>& search, const engine::Board<engine::TicTacToe>& board, util::Rng& rng, const Config& config);
+    template void start(AsyncSearch<engine::ConnectFive>& async, Search<engine::ConnectFive>& search, const engine::Board<engine::ConnectFive>& board, util::Rng& rng, const Config& config);
+    template void start(AsyncSearch<engine::Gomoku>& async, Search<engine::Gomoku>& search, const engine::Board<engine::Gomoku>& board, util::Rng& rng, const Config& config);
+
+    template bool is_running(const AsyncSearch<engine::TicTacToe>& async);
+    template bool is_running(const AsyncSearch<engine::ConnectFive>& async);
+    template bool is_running(const AsyncSearch<engine::Gomoku>& async);
+
+    template bool poll(AsyncSearch<engine::TicTacToe>& async, Progress<engine::TicTacToe>& progress);
+    template bool poll(AsyncSearch<engine::ConnectFive>& async, Progress<engine::ConnectFive>& progress);
+    template bool poll(AsyncSearch<engine::Gomoku>& async, Progress<engine::Gomoku>& progress);
+
+    template void cancel(AsyncSearch<engine::TicTacToe>& async);
+    template void cancel(AsyncSearch<engine::ConnectFive>& async);
+    template void cancel(AsyncSearch<engine::Gomoku>& async);
 } // namespace mcts
 } // namespace tic_tac_toe
@@ -2,9 +2,188 @@
 #pragma once
 
 #include "engine.hpp"
+#include "util.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// per phase timers and the other counters kept on every iteration cost a few clock reads each time,
+// so they are only compiled in when the build defines MCTS_STATS to 1
+#if !defined(MCTS_STATS)
+#define MCTS_STATS 0
+#endif
 
 namespace tic_tac_toe {
+namespace thread_pool {
+    struct ThreadPool;
+} // namespace thread_pool
+
 namespace mcts {
-    void generate_computer_moves(engine::Board& board);
+    enum class Parallelism : U8 {
+        Root, // every thread searches its own tree, the trees are merged at the root
+        Tree // every thread searches one shared tree
+    };
+
+    // a search clamps thread_count, rollouts_per_leaf, max_iterations and max_nodes to at least 1,
+    // and rollouts_per_leaf to at most rollout::max_batch_size, 32, rather than failing
+    struct Config {
+        U32 thread_count = 1;
+        Parallelism parallelism = Parallelism::Root;
+        // visits a tree parallel thread adds to each node on its path until its result is backpropagated,
+        // so that other threads prefer the siblings in the meantime
+        U32 virtual_loss = 1;
+        // random games played from every selected node, more than one plays them as a batch in simd lanes
+        U32 rollouts_per_leaf = 1;
+        // progressive widening, a node tries at most ceil(widening_scale * visits^widening_exponent) of its moves,
+        // the untried ones in random order, so a big board spends its visits deeper rather than on every reply
+        // 0 turns it off and every move of a node is tried once before any is tried again
+        float widening_scale = 0.0f;
+        float widening_exponent = 0.5f;
+        // rave, every move also keeps all moves as first statistics, from the iterations where its player went on to play it
+        // later, blended into its mean with a weight of sqrt(rave_equivalence / (3 * visits + rave_equivalence))
+        // it needs an edge for every move, so a node gets all of them at once and widening is off, and rollouts are
+        // played one at a time, as the simd batches do not report the moves of their games
+        // edges are capped at 1 << 24 whatever max_nodes allows, so on gomoku, where a node takes up to 232 edge slots,
+        // they run out once about 72 thousand nodes have their moves, some 700 thousand iterations from the empty board,
+        // and the search stops early and reports it with Stats::edges_exhausted
+        bool rave = false;
+        float rave_equivalence = 300.0f;
+
+        // the search stops at whichever limit comes first, or earlier once no move can overtake the best one
+        // in what is left of the budget
+        // only the iterations of this search count, a reused tree's visits come on top of them
+        U32 max_iterations = 100 * 1000;
+        // a node's edges are allocated in blocks of 8 as its moves are tried, so this bounds the memory of the search
+        // the pool is allocated up front, 21 bytes a node plus 4 to 8 for its transposition table entry,
+        // and 13.5 bytes an edge, 21.5 with rave, counting the link every block of 8 has to the next
+        // there is room for 16 edges a node, or for every move of a node with rave, up to 1 << 24 edges in all
+        U32 max_nodes = 1 << 22;
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    };
+
+    struct Tree; // defined in mcts.cpp
+
+    // keeps the search graph between calls, so the next search starts from everything already learned below its position
+    // before searching, the node of the new position becomes the root and every node not reachable from it is freed,
+    // if the graph never reached the position it starts over
+    // every Search has threads of its own, so searches on different ones can run at the same time,
+    // but one Search only runs one search at a time
+    template <typename Rules>
+    struct Search {
+        Search();
+        ~Search();
+        Search(const Search&) = delete;
+        Search& operator=(const Search&) = delete;
+
+        std::vector<Tree> trees; // one per root parallel thread, empty until the first search
+        U32 thread_count;
+        Parallelism parallelism;
+        std::unique_ptr<thread_pool::ThreadPool> threads; // started by the first search with more than one thread
+    };
+
+    // the exact result of a position once the search has seen every line that matters below it,
+    // for the player to move there, or for the player making a move when it is about a move
+    enum class Proof : U8 {
+        None, // not proven yet
+        Win,
+        Loss,
+        Draw
+    };
+
+    // what a search did and where its time went
+    // the totals and the root visits are always filled in, the rest only when built with MCTS_STATS and 0 otherwise
+    template <typename Rules>
+    struct Stats {
+        double seconds; // wall time of the whole search
+        U32 iteration_count; // of this search, the iterations a reused tree brought along are not counted
+        U32 node_count; // nodes this search allocated
+        // the edge pool ran out, which stops the search before its budget, any tree of root parallelism counts
+        bool edges_exhausted;
+        // root visits a reused tree brought along and root visits this search added, summed over the trees of root parallelism
+        U32 reused_visit_count;
+        U32 new_visit_count;
+        engine::CellIndex move_count; // the moves the root tried and their visits, summed over the trees of root parallelism
+        engine::CellIndex cells[Rules::cell_count];
+        U32 visit_counts[Rules::cell_count];
+        Proof proof; // of the root, the search stops as soon as it has one
+
+        // summed over the threads, so with several threads they add up to more than seconds
+        double select_seconds; // expansion not included
+        double expand_seconds; // adding edges for untried moves
+        double simulate_seconds;
+        double backprop_seconds;
+        U32 max_depth; // moves from the root to the deepest selected node
+        // only rollouts played one at a time count, the simd batches do not report how long their games were
+        U64 rollout_count;
+        U64 rollout_move_count;
+    };
+
+    // bytes of the nodes, edges and transposition tables of every tree
+    // the pools are allocated for the whole budget up front, but nodes and edges are only written once they are used
+    struct MemoryUsage {
+        U64 allocated_bytes;
+        U64 used_bytes;
+    };
+
+    template <typename Rules>
+    MemoryUsage get_memory_usage(const Search<Rules>& search);
+
+    // rng seeds every thread of the search, so equal seeds give equal results
+    // instantiated for engine::TicTacToe, engine::ConnectFive and engine::Gomoku
+    template <typename Rules>
+    Stats<Rules> generate_computer_moves(Search<Rules>& search, engine::Board<Rules>& board, util::Rng& rng, const Config& config = Config{});
+
+    // searches from scratch, with threads started for this search alone
+    template <typename Rules>
+    Stats<Rules> generate_computer_moves(engine::Board<Rules>& board, util::Rng& rng, const Config& config = Config{});
+
+    // what a running search has found so far
+    template <typename Rules>
+    struct Progress {
+        engine::CellIndex cells[Rules::cell_count]; // the moves the root has tried, in the order it first tried them
+        U32 visit_counts[Rules::cell_count];
+        engine::CellIndex move_count; // 0 until the root has tried a move
+        U32 iteration_count;
+    };
+
+    // a search on a thread of its own, so the caller keeps running while it works
+    // the search publishes its root statistics every few hundred iterations and poll reads the latest of them
+    // with root parallelism they are the statistics of the first tree only
+    template <typename Rules>
+    struct AsyncSearch {
+        AsyncSearch();
+        ~AsyncSearch(); // cancels a running search
+        AsyncSearch(const AsyncSearch&) = delete;
+        AsyncSearch& operator=(const AsyncSearch&) = delete;
+
+        std::thread thread; // joinable from start until poll sees the search finish or cancel stops it
+        std::atomic<bool> cancelled;
+        std::atomic<bool> finished;
+        std::mutex mutex; // guards progress
+        Progress<Rules> progress;
+        engine::Board<Rules> board; // a copy of the searched board, holds the best moves once the search has finished
+        Stats<Rules> stats; // of the search, once it has finished
+        util::Rng rng;
+    };
+
+    // cancels the search already running, if any, and searches board on a new thread
+    // search is used by that thread until the search finishes or is cancelled, so it must not be touched meanwhile
+    template <typename Rules>
+    void start(AsyncSearch<Rules>& async, Search<Rules>& search, const engine::Board<Rules>& board, util::Rng& rng, const Config& config = Config{});
+
+    template <typename Rules>
+    bool is_running(const AsyncSearch<Rules>& async);
+
+    // copies the latest progress, returns true once when the search has finished and async.board holds its best moves
+    // and async.stats its statistics
+    template <typename Rules>
+    bool poll(AsyncSearch<Rules>& async, Progress<Rules>& progress);
+
+    // stops a running search and waits for its thread, its tree keeps everything found so far
+    template <typename Rules>
+    void cancel(AsyncSearch<Rules>& async);
 } // namespace mcts
 } // namespace tic_tac_toe
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "perfect_play.hpp"
+#include "engine.hpp"
+#include "util.hpp"
+
+namespace tic_tac_toe {
+namespace perfect_play {
+    using Rules = engine::TicTacToe;
+    using Mask = Rules::Mask;
+
+    // a position is encoded as 9 base 3 digits, 0 for empty, 1 for O and 2 for X
+    // 3^9 codes, of which 5478 are legal positions
+    static constexpr U32 code_count = 19683;
+
+    // a cell mask read as base 3 digits, so a position encodes as base3[o] + 2 * base3[x]
+    struct Base3 {
+        U16 values[512];
+    };
+
+    static constexpr Base3 base3 = [] {
+        Base3 result{};
+        for (U32 mask = 0; mask < 512; ++mask) {
+            U32 power = 1;
+            for (U32 i = 0; i < 9; ++i) {
+                result.values[mask] += static_cast<U16>(((mask >> i) & 1) * power);
+                power *= 3;
+            }
+        }
+        return result;
+    }();
+
+    struct Table {
+        Mask best_moves[code_count]; // indexed by code, 0 for finished games and illegal codes
+    };
+
+    // values are for the player to move, 0 means not solved yet so a zero initialised solver starts out empty
+    enum Value : U8 {
+        Unsolved,
+        Loss,
+        Draw,
+        Win
+    };
+
+    struct Solver {
+        Table table;
+        U8 values[code_count];
+    };
+
+    static constexpr bool has_line(Mask cells) {
+        for (const Mask line : engine::win_lines<Rules>.lines) {
+            if ((cells & line) == line) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // only positions reachable by legal play are visited, and each of them is solved once
+    static constexpr U8 solve(Solver& solver, Mask mover, Mask opponent, U32 code, U32 mover_digit) {
+        if (solver.values[code] != Unsolved) {
+            return solver.values[code];
+        }
+
+        U8 value;
+        if (has_line(opponent)) {
+            value = Loss;
+        } else if ((mover | opponent) == engine::full_mask<Rules>) {
+            value = Draw;
+        } else {
+            value = Loss;
+            Mask best_moves = 0;
+            const Mask empty_cells = ~(mover | opponent) & engine::full_mask<Rules>;
+            for (U32 i = 0; i < 9; ++i) {
+                const Mask cell = static_cast<Mask>(1u << i);
+                if (!(empty_cells & cell)) {
+                    continue;
+                }
+
+                const U32 child_code = code + mover_digit * base3.values[cell];
+                const U8 child_value = Win + Loss - solve(solver, opponent, mover | cell, child_code, 3 - mover_digit);
+                if (child_value > value || best_moves == 0) {
+                    value = child_value;
+                    best_moves = cell;
+                } else if (child_value == value) {
+                    best_moves |= cell;
+                }
+            }
+            solver.table.best_moves[code] = best_moves;
+        }
+
+        solver.values[code] = value;
+        return value;
+    }
+
+    static constexpr Table table = [] {
+        Solver solver{};
+        // O always moves first
+        solve(solver, 0, 0, 0, 1);
+        return solver.table;
+    }();
+
+    Mask get_best_moves(const engine::SearchState<Rules>& state) {
+        const U32 code = base3.values[state.cells[static_cast<U8>(engine::Player::O)]]
+            + 2u * base3.values[state.cells[static_cast<U8>(engine::Player::X)]];
+        return table.best_moves[code];
+    }
+} // namespace perfect_play
+} // namespace tic_tac_toe
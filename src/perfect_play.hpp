@@ -0,0 +1,11 @@
+#pragma once
+
+#include "engine.hpp"
+
+namespace tic_tac_toe {
+namespace perfect_play {
+    // every equally optimal tic-tac-toe move of the player to move, from a table solved at compile time
+    // 0 if the game is over
+    engine::TicTacToe::Mask get_best_moves(const engine::SearchState<engine::TicTacToe>& state);
+} // namespace perfect_play
+} // namespace tic_tac_toe
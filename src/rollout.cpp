@@ -0,0 +1,242 @@
+#include "rollout.hpp"
+#include "engine.hpp"
+#include "util.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace tic_tac_toe {
+namespace rollout {
+    BatchRng make_batch_rng(util::Rng& rng) {
+        BatchRng result;
+        for (U32 lane = 0; lane < max_batch_size; ++lane) {
+            util::Rng lane_rng = util::make_rng(util::next_u64(rng));
+            for (U32 word = 0; word < 4; ++word) {
+                result.state[word][lane] = lane_rng.state[word];
+            }
+        }
+        return result;
+    }
+
+    static engine::GameEnd win_for(engine::Player player) {
+        return player == engine::Player::O ? engine::GameEnd::OWin : engine::GameEnd::XWin;
+    }
+
+    // whether the move that fills the board down to empty_count - 1 empty cells can win
+    // only the lanes check every line, so like engine::detect_win they skip the moves before anyone has win_length pieces
+    template <typename Rules>
+    static constexpr bool is_win_possible(U32 empty_count) {
+        return Rules::cell_count - empty_count + 1 >= 2 * Rules::win_length - 1;
+    }
+
+    // moves are drawn as (random * empty_count) >> 32 without rejection, the bias is below 2^-28
+    // and not worth a data dependent loop in every lane
+
+#if defined(__AVX2__)
+    static __m256i rotate_left(__m256i x, int k) {
+        return _mm256_or_si256(_mm256_slli_epi32(x, k), _mm256_srli_epi32(x, 32 - k));
+    }
+
+    // high half of the 64 bit product of each lane with b
+    static __m256i multiply_high(__m256i a, __m256i b) {
+        const __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(a, b), 32);
+        const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+        return _mm256_blend_epi32(even, odd, 0b10101010);
+    }
+
+    template <typename Rules>
+    static void simulate_lanes(const engine::SearchState<Rules>& state, U32 first_lane, U32 count, BatchRng& rng, engine::GameEnd results[]) {
+        __m256i s0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(rng.state[0] + first_lane));
+        __m256i s1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(rng.state[1] + first_lane));
+        __m256i s2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(rng.state[2] + first_lane));
+        __m256i s3 = _mm256_load_si256(reinterpret_cast<const __m256i*>(rng.state[3] + first_lane));
+
+        __m256i cells[2] = {
+            _mm256_set1_epi32(static_cast<int>(state.cells[static_cast<U8>(engine::Player::O)])),
+            _mm256_set1_epi32(static_cast<int>(state.cells[static_cast<U8>(engine::Player::X)]))
+        };
+        const __m256i full = _mm256_set1_epi32(static_cast<int>(engine::full_mask<Rules>));
+        __m256i alive = _mm256_set1_epi32(-1);
+        __m256i result = _mm256_set1_epi32(static_cast<int>(engine::GameEnd::None));
+
+        engine::Player player = state.next_turn;
+        for (U32 empty_count = Rules::cell_count - state.ply; empty_count > 0; --empty_count) {
+            // xoshiro128** in every lane
+            const __m256i x = _mm256_add_epi32(_mm256_slli_epi32(s1, 2), s1);
+            const __m256i rotated = rotate_left(x, 7);
+            const __m256i random = _mm256_add_epi32(_mm256_slli_epi32(rotated, 3), rotated);
+            const __m256i t = _mm256_slli_epi32(s1, 9);
+            s2 = _mm256_xor_si256(s2, s0);
+            s3 = _mm256_xor_si256(s3, s1);
+            s1 = _mm256_xor_si256(s1, s2);
+            s0 = _mm256_xor_si256(s0, s3);
+            s2 = _mm256_xor_si256(s2, t);
+            s3 = rotate_left(s3, 11);
+
+            // the k-th empty cell of every lane
+            const __m256i k = multiply_high(random, _mm256_set1_epi32(static_cast<int>(empty_count)));
+            const __m256i empty = _mm256_andnot_si256(_mm256_or_si256(cells[0], cells[1]), full);
+            __m256i seen = _mm256_setzero_si256();
+            __m256i chosen = _mm256_setzero_si256();
+            for (U32 i = 0; i < Rules::cell_count; ++i) {
+                const __m256i bit = _mm256_set1_epi32(static_cast<int>(1u << i));
+                const __m256i is_empty = _mm256_cmpeq_epi32(_mm256_and_si256(empty, bit), bit);
+                const __m256i is_chosen = _mm256_and_si256(is_empty, _mm256_cmpeq_epi32(seen, k));
+                chosen = _mm256_or_si256(chosen, _mm256_and_si256(is_chosen, bit));
+                seen = _mm256_sub_epi32(seen, is_empty);
+            }
+
+            __m256i& mover = cells[static_cast<U8>(player)];
+            mover = _mm256_or_si256(mover, _mm256_and_si256(chosen, alive));
+
+            if (is_win_possible<Rules>(empty_count)) {
+                __m256i won = _mm256_setzero_si256();
+                for (const typename Rules::Mask line_mask : engine::win_lines<Rules>.lines) {
+                    const __m256i line = _mm256_set1_epi32(static_cast<int>(line_mask));
+                    won = _mm256_or_si256(won, _mm256_cmpeq_epi32(_mm256_and_si256(mover, line), line));
+                }
+                won = _mm256_and_si256(won, alive);
+                result = _mm256_blendv_epi8(result, _mm256_set1_epi32(static_cast<int>(win_for(player))), won);
+                alive = _mm256_andnot_si256(won, alive);
+
+                if (_mm256_testz_si256(alive, alive)) {
+                    break;
+                }
+            }
+
+            player = engine::other(player);
+        }
+
+        // games still running when the board filled up are draws
+        result = _mm256_blendv_epi8(result, _mm256_set1_epi32(static_cast<int>(engine::GameEnd::Draw)), alive);
+
+        _mm256_store_si256(reinterpret_cast<__m256i*>(rng.state[0] + first_lane), s0);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(rng.state[1] + first_lane), s1);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(rng.state[2] + first_lane), s2);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(rng.state[3] + first_lane), s3);
+
+        alignas(32) U32 lane_results[lane_count];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lane_results), result);
+        for (U32 i = 0; i < count; ++i) {
+            results[first_lane + i] = static_cast<engine::GameEnd>(lane_results[i]);
+        }
+    }
+#else
+    // plain loops over the lanes, written without branches so the compiler can vectorise them
+    template <typename Rules>
+    static void simulate_lanes(const engine::SearchState<Rules>& state, U32 first_lane, U32 count, BatchRng& rng, engine::GameEnd results[]) {
+        U32 cells[2][lane_count];
+        U32 alive[lane_count];
+        U32 lane_results[lane_count];
+        for (U32 lane = 0; lane < lane_count; ++lane) {
+            cells[0][lane] = state.cells[static_cast<U8>(engine::Player::O)];
+            cells[1][lane] = state.cells[static_cast<U8>(engine::Player::X)];
+            alive[lane] = 0xFFFFFFFF;
+            lane_results[lane] = static_cast<U32>(engine::GameEnd::None);
+        }
+
+        engine::Player player = state.next_turn;
+        for (U32 empty_count = Rules::cell_count - state.ply; empty_count > 0; --empty_count) {
+            U32 any_alive = 0;
+            U32* mover = cells[static_cast<U8>(player)];
+            const U32 win = static_cast<U32>(win_for(player));
+            const bool check_win = is_win_possible<Rules>(empty_count);
+            for (U32 lane = 0; lane < lane_count; ++lane) {
+                U32& s0 = rng.state[0][first_lane + lane];
+                U32& s1 = rng.state[1][first_lane + lane];
+                U32& s2 = rng.state[2][first_lane + lane];
+                U32& s3 = rng.state[3][first_lane + lane];
+                const U32 random = util::rotate_left(s1 * 5, 7) * 9;
+                const U32 t = s1 << 9;
+                s2 ^= s0;
+                s3 ^= s1;
+                s1 ^= s2;
+                s0 ^= s3;
+                s2 ^= t;
+                s3 = util::rotate_left(s3, 11);
+
+                const U32 k = static_cast<U32>((static_cast<U64>(random) * empty_count) >> 32);
+                const U32 empty = ~(cells[0][lane] | cells[1][lane]) & engine::full_mask<Rules>;
+                U32 seen = 0;
+                U32 chosen = 0;
+                for (U32 i = 0; i < Rules::cell_count; ++i) {
+                    const U32 is_empty = (empty >> i) & 1;
+                    chosen |= (is_empty & static_cast<U32>(seen == k)) << i;
+                    seen += is_empty;
+                }
+
+                mover[lane] |= chosen & alive[lane];
+
+                U32 won = 0;
+                if (check_win) {
+                    for (const typename Rules::Mask line : engine::win_lines<Rules>.lines) {
+                        won |= static_cast<U32>((mover[lane] & line) == line);
+                    }
+                }
+                const U32 won_mask = (0u - won) & alive[lane];
+                lane_results[lane] = (lane_results[lane] & ~won_mask) | (win & won_mask);
+                alive[lane] &= ~won_mask;
+                any_alive |= alive[lane];
+            }
+
+            if (!any_alive) {
+                break;
+            }
+
+            player = engine::other(player);
+        }
+
+        for (U32 i = 0; i < count; ++i) {
+            // games still running when the board filled up are draws
+            results[first_lane + i] = alive[i] ? engine::GameEnd::Draw : static_cast<engine::GameEnd>(lane_results[i]);
+        }
+    }
+#endif
+
+    // one game after another, each with the generator of its lane
+    template <typename Rules>
+    static void simulate_games(const engine::SearchState<Rules>& state, U32 count, BatchRng& rng, engine::GameEnd results[]) {
+        for (U32 lane = 0; lane < count; ++lane) {
+            util::Rng lane_rng;
+            for (U32 word = 0; word < 4; ++word) {
+                lane_rng.state[word] = rng.state[word][lane];
+            }
+
+            engine::SearchState<Rules> game = state;
+            while (game.game_end == engine::GameEnd::None) {
+                engine::play_move(game, engine::get_random_move(game, lane_rng));
+            }
+            results[lane] = game.game_end;
+
+            for (U32 word = 0; word < 4; ++word) {
+                rng.state[word][lane] = lane_rng.state[word];
+            }
+        }
+    }
+
+    template <typename Rules>
+    void simulate_batch(const engine::SearchState<Rules>& state, U32 count, BatchRng& rng, engine::GameEnd results[]) {
+        assert(count <= max_batch_size);
+
+        if (state.game_end != engine::GameEnd::None) {
+            for (U32 i = 0; i < count; ++i) {
+                results[i] = state.game_end;
+            }
+            return;
+        }
+
+        if constexpr (Rules::cell_count <= 32) {
+            for (U32 first_lane = 0; first_lane < count; first_lane += lane_count) {
+                simulate_lanes(state, first_lane, util::min(count - first_lane, lane_count), rng, results);
+            }
+        } else {
+            simulate_games(state, count, rng, results);
+        }
+    }
+
+    template void simulate_batch(const engine::SearchState<engine::TicTacToe>& state, U32 count, BatchRng& rng, engine::GameEnd results[]);
+    template void simulate_batch(const engine::SearchState<engine::ConnectFive>& state, U32 count, BatchRng& rng, engine::GameEnd results[]);
+    template void simulate_batch(const engine::SearchState<engine::Gomoku>& state, U32 count, BatchRng& rng, engine::GameEnd results[]);
+} // namespace rollout
+} // namespace tic_tac_toe
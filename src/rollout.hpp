@@ -0,0 +1,24 @@
+#pragma once
+
+#include "engine.hpp"
+#include "util.hpp"
+
+namespace tic_tac_toe {
+namespace rollout {
+    static constexpr U32 lane_count = 8;
+    static constexpr U32 max_batch_size = 32;
+
+    // one xoshiro128** generator per lane, stored word by word so each word loads as one vector
+    struct BatchRng {
+        alignas(32) U32 state[4][max_batch_size];
+    };
+
+    BatchRng make_batch_rng(util::Rng& rng);
+
+    // plays count random games to the end from state in lockstep, count must be at most max_batch_size
+    // every game starts from the same position, so they all share the side to move and the number of empty cells
+    // boards of more than 32 cells do not fit a lane and play their games one after another
+    template <typename Rules>
+    void simulate_batch(const engine::SearchState<Rules>& state, U32 count, BatchRng& rng, engine::GameEnd results[]);
+} // namespace rollout
+} // namespace tic_tac_toe
@@ -0,0 +1,285 @@
+#include "test.hpp"
+#include "engine.hpp"
+#include "mcts.hpp"
+#include "perfect_play.hpp"
+#include "rollout.hpp"
+#include "tree_search.hpp"
+#include "util.hpp"
+#include <cstdio>
+#include <unordered_set>
+#include <vector>
+
+namespace tic_tac_toe {
+namespace test {
+    // the perfect play table only exists for tic-tac-toe
+    using Rules = engine::TicTacToe;
+    using Mask = Rules::Mask;
+
+    static constexpr U64 seed = 420;
+
+    // every position a game can reach with the game still running, each once however many move orders lead to it
+    static std::vector<engine::Board<Rules>> get_positions() {
+        std::vector<engine::Board<Rules>> result;
+        std::unordered_set<U64> seen;
+        std::vector<engine::Board<Rules>> stack(1);
+        while (!stack.empty()) {
+            const engine::Board<Rules> board = stack.back();
+            stack.pop_back();
+            if (board.state.game_end != engine::GameEnd::None || !seen.insert(engine::get_hash(board.state)).second) {
+                continue;
+            }
+
+            result.push_back(board);
+            const Mask empty = engine::get_empty_cells(board.state);
+            for (U32 i = 0; i < engine::count_cells(empty); ++i) {
+                engine::Board<Rules> child = board;
+                engine::play_move(child, engine::get_coordinate<Rules>(engine::get_nth_cell(empty, i)));
+                stack.push_back(child);
+            }
+        }
+        return result;
+    }
+
+    static Mask get_best_moves(const engine::Board<Rules>& board) {
+        Mask result{};
+        for (engine::CellIndex i = 0; i < board.ai_best_moves_count; ++i) {
+            result |= engine::get_cell_mask<Mask>(engine::index<Rules>(board.ai_best_moves[i]));
+        }
+        return result;
+    }
+
+    static void print_cells(Mask cells) {
+        std::fprintf(stderr, "{");
+        for (U32 i = 0; i < engine::count_cells(cells); ++i) {
+            std::fprintf(stderr, i == 0 ? "%u" : " %u", static_cast<U32>(engine::get_nth_cell(cells, i)));
+        }
+        std::fprintf(stderr, "}");
+    }
+
+    static void print_failure(const char* name, const engine::Board<Rules>& board, Mask moves, Mask optimal_moves) {
+        std::fprintf(stderr, "%s: o ", name);
+        print_cells(board.state.cells[static_cast<U8>(engine::Player::O)]);
+        std::fprintf(stderr, " x ");
+        print_cells(board.state.cells[static_cast<U8>(engine::Player::X)]);
+        std::fprintf(stderr, " picked ");
+        print_cells(moves);
+        std::fprintf(stderr, " optimal ");
+        print_cells(optimal_moves);
+        std::fprintf(stderr, "\n");
+    }
+
+    // the exhaustive searches have to find exactly the table's moves
+    template <tree_search::Mode mode>
+    static U32 check_tree_search(const char* name, const engine::Board<Rules>& position, Mask optimal_moves) {
+        engine::Board<Rules> board = position;
+        tree_search::generate_computer_moves<mode>(board);
+        const Mask moves = get_best_moves(board);
+        if (moves != optimal_moves) {
+            print_failure(name, position, moves, optimal_moves);
+            return 1;
+        }
+        return 0;
+    }
+
+    // a node select stops on because every move it has is proven to win or lose has to be proven itself,
+    // otherwise it would be simulated with random games for the rest of the search
+    // test_main builds the searches into the same translation unit, so the check can drive select between iterations
+    static U32 check_mcts_leaves(const engine::Board<Rules>& position, U64 rng_seed) {
+        const mcts::Config config{};
+        util::Rng rng = util::make_rng(rng_seed);
+        rollout::BatchRng batch_rng = rollout::make_batch_rng(rng);
+        mcts::Tree tree;
+        mcts::set_root(tree, position.state, config);
+        mcts::Counters counters{};
+        for (U32 i = 0; i < 2000 && tree.pool.node_proofs[tree.root] == mcts::Proof::None; ++i) {
+            engine::SearchState<Rules> state = position.state;
+            mcts::Path<Rules> path;
+            mcts::select<Rules, false>(state, tree.pool, tree.root, config, 0, rng, path, counters);
+            const mcts::NodeIndex leaf = path.nodes[path.count - 1];
+            if (state.game_end == engine::GameEnd::None && tree.pool.node_proofs[leaf] == mcts::Proof::None
+                && mcts::prove<false>(tree.pool, leaf, Rules::cell_count - state.ply) != mcts::Proof::None) {
+                print_failure("mcts_leaf", position, Mask{}, perfect_play::get_best_moves(position.state));
+                return 1;
+            }
+
+            mcts::iterate<Rules, false>(position.state, tree.pool, tree.root, config, rng, batch_rng, counters);
+        }
+        return 0;
+    }
+
+    // the configurations mcts is checked with, each option that changes how the search works on its own,
+    // with about the rollouts of the default budget
+    struct MctsVariant {
+        const char* name;
+        mcts::Config config;
+    };
+
+    static std::vector<MctsVariant> get_mcts_variants() {
+        std::vector<MctsVariant> result;
+        result.push_back({"mcts", mcts::Config{}});
+
+        mcts::Config config{};
+        config.thread_count = 4;
+        config.parallelism = mcts::Parallelism::Root;
+        // every tree gets the whole budget, so the trees share out the rollouts of the default one
+        config.max_iterations /= config.thread_count;
+        result.push_back({"mcts_root_parallel", config});
+
+        config = mcts::Config{};
+        config.thread_count = 4;
+        config.parallelism = mcts::Parallelism::Tree;
+        result.push_back({"mcts_tree_parallel", config});
+
+        config = mcts::Config{};
+        config.rave = true;
+        result.push_back({"mcts_rave", config});
+
+        config = mcts::Config{};
+        config.widening_scale = 1.0f;
+        result.push_back({"mcts_widening", config});
+
+        config = mcts::Config{};
+        config.rollouts_per_leaf = 8;
+        config.max_iterations /= config.rollouts_per_leaf;
+        result.push_back({"mcts_batch", config});
+        return result;
+    }
+
+    // bounds the nodes a search allocates the way the pool capacity does, with a tree for every root parallel thread
+    static U32 get_node_limit(const mcts::Config& config) {
+        const U32 tree_count = config.parallelism == mcts::Parallelism::Root ? config.thread_count : 1;
+        return tree_count * (1 + 2 * config.max_iterations);
+    }
+
+    // mcts only has to pick among the table's moves, and every root visit it adds has to come from one of its iterations
+    static U32 check_mcts(const char* name, const engine::Board<Rules>& position, Mask optimal_moves, const mcts::Stats<Rules>& stats, const engine::Board<Rules>& board, const mcts::Config& config) {
+        const Mask moves = get_best_moves(board);
+        if (moves == Mask{} || (moves & optimal_moves) != moves) {
+            print_failure(name, position, moves, optimal_moves);
+            return 1;
+        }
+        const U32 node_limit = get_node_limit(config);
+        if (stats.node_count > node_limit) {
+            std::fprintf(stderr, "%s: %u nodes, at most %u expected\n", name, stats.node_count, node_limit);
+            return 1;
+        }
+        if (stats.new_visit_count != stats.iteration_count * util::max(config.rollouts_per_leaf, 1)) {
+            std::fprintf(stderr, "%s: %u new visits from %u iterations\n", name, stats.new_visit_count, stats.iteration_count);
+            return 1;
+        }
+        return 0;
+    }
+
+    // a reused tree searched again with a smaller budget, first on the same position and then on one of its replies,
+    // its visits come on top of the new budget rather than counting against it
+    static U32 check_mcts_reuse(const engine::Board<Rules>& position, Mask optimal_moves, U64 rng_seed) {
+        mcts::Search<Rules> search;
+        util::Rng rng = util::make_rng(rng_seed);
+        mcts::Config config{};
+        config.max_iterations = 20000;
+        engine::Board<Rules> board = position;
+        U32 failure_count = check_mcts("mcts_reuse", position, optimal_moves, mcts::generate_computer_moves(search, board, rng, config), board, config);
+
+        config.max_iterations = 500;
+        board = position;
+        const mcts::Stats<Rules> stats = mcts::generate_computer_moves(search, board, rng, config);
+        failure_count += check_mcts("mcts_reuse_smaller", position, optimal_moves, stats, board, config);
+        if (stats.reused_visit_count == 0) {
+            std::fprintf(stderr, "mcts_reuse_smaller: no visits reused\n");
+            ++failure_count;
+        }
+
+        const Mask empty = engine::get_empty_cells(position.state);
+        engine::Board<Rules> reply = position;
+        engine::play_move(reply, engine::get_coordinate<Rules>(engine::get_nth_cell(empty, 0)));
+        if (reply.state.game_end != engine::GameEnd::None) {
+            return failure_count;
+        }
+
+        config.max_iterations = 200;
+        board = reply;
+        failure_count += check_mcts("mcts_reuse_reply", reply, perfect_play::get_best_moves(reply.state), mcts::generate_computer_moves(search, board, rng, config), board, config);
+        return failure_count;
+    }
+
+    // counts out of range are clamped rather than run as they are, so a search still plays legal moves
+    // and every root visit still comes from one of its iterations
+    static U32 check_mcts_limits(const engine::Board<Rules>& position, U64 rng_seed) {
+        struct Limit {
+            const char* name;
+            mcts::Config config;
+            U32 rollouts_per_leaf; // what the search clamps it to
+        };
+
+        std::vector<Limit> limits;
+        mcts::Config config{};
+        config.max_iterations = 0;
+        limits.push_back({"mcts_no_iterations", config, 1});
+
+        config = mcts::Config{};
+        config.thread_count = 0;
+        limits.push_back({"mcts_no_threads", config, 1});
+
+        config = mcts::Config{};
+        config.max_nodes = 0;
+        limits.push_back({"mcts_no_nodes", config, 1});
+
+        config = mcts::Config{};
+        config.max_iterations = 1000;
+        config.rollouts_per_leaf = 0;
+        limits.push_back({"mcts_no_rollouts", config, 1});
+
+        config.rollouts_per_leaf = rollout::max_batch_size;
+        limits.push_back({"mcts_full_batch", config, rollout::max_batch_size});
+
+        config.rollouts_per_leaf = rollout::max_batch_size + 1;
+        limits.push_back({"mcts_over_full_batch", config, rollout::max_batch_size});
+
+        U32 failure_count = 0;
+        for (const Limit& limit : limits) {
+            engine::Board<Rules> board = position;
+            util::Rng rng = util::make_rng(rng_seed);
+            const mcts::Stats<Rules> stats = mcts::generate_computer_moves(board, rng, limit.config);
+            const Mask moves = get_best_moves(board);
+            if (stats.iteration_count == 0 || moves == Mask{} || (moves & engine::get_empty_cells(position.state)) != moves) {
+                print_failure(limit.name, position, moves, engine::get_empty_cells(position.state));
+                ++failure_count;
+            } else if (stats.new_visit_count != stats.iteration_count * limit.rollouts_per_leaf) {
+                std::fprintf(stderr, "%s: %u new visits from %u iterations\n", limit.name, stats.new_visit_count, stats.iteration_count);
+                ++failure_count;
+            }
+        }
+        return failure_count;
+    }
+
+    int run() {
+        const std::vector<engine::Board<Rules>> positions = get_positions();
+        const std::vector<MctsVariant> mcts_variants = get_mcts_variants();
+
+        U32 failure_count = 0;
+        for (U32 i = 0; i < positions.size(); ++i) {
+            const engine::Board<Rules>& position = positions[i];
+            const Mask optimal_moves = perfect_play::get_best_moves(position.state);
+            failure_count += check_tree_search<tree_search::Mode::Table>("table", position, optimal_moves);
+            failure_count += check_tree_search<tree_search::Mode::Memoized>("memoized", position, optimal_moves);
+            failure_count += check_tree_search<tree_search::Mode::AlphaBeta>("alpha_beta", position, optimal_moves);
+
+            for (const MctsVariant& variant : mcts_variants) {
+                engine::Board<Rules> board = position;
+                util::Rng rng = util::make_rng(seed + i);
+                const mcts::Stats<Rules> stats = mcts::generate_computer_moves(board, rng, variant.config);
+                failure_count += check_mcts(variant.name, position, optimal_moves, stats, board, variant.config);
+            }
+            failure_count += check_mcts_leaves(position, seed + i);
+            failure_count += check_mcts_reuse(position, optimal_moves, seed + i);
+        }
+        // the limits only need a few positions, the empty board and the first ones found from it
+        for (U32 i = 0; i < 16; ++i) {
+            failure_count += check_mcts_limits(positions[i], seed + i);
+        }
+
+        std::printf("%u positions, %u failures\n", static_cast<U32>(positions.size()), failure_count);
+        return failure_count == 0 ? 0 : 1;
+    }
+} // namespace test
+} // namespace tic_tac_toe
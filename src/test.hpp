@@ -0,0 +1,10 @@
+#pragma once
+
+namespace tic_tac_toe {
+namespace test {
+    // checks the searches against the perfect play table on every reachable tic-tac-toe position,
+    // mcts in each of its configurations and with its tree reused between budgets,
+    // prints every disagreement to stderr and returns 0 if there was none
+    int run();
+} // namespace test
+} // namespace tic_tac_toe
@@ -0,0 +1,11 @@
+#include "engine.cpp"
+#include "thread_pool.cpp"
+#include "rollout.cpp"
+#include "mcts.cpp"
+#include "perfect_play.cpp"
+#include "tree_search.cpp"
+#include "test.cpp"
+
+int main() {
+    return tic_tac_toe::test::run();
+}
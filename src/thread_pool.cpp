@@ -0,0 +1,94 @@
+#include "thread_pool.hpp"
+#include <cassert>
+
+namespace tic_tac_toe {
+namespace thread_pool {
+    // claims and runs tasks of the current batch until there are none left, lock must be held on entry
+    static void work(ThreadPool& pool, std::unique_lock<std::mutex>& lock) {
+        while (pool.next_task < pool.task_count) {
+            const U32 index = pool.next_task;
+            ++pool.next_task;
+            const std::function<void(U32)>& task = *pool.task;
+
+            lock.unlock();
+            task(index);
+            lock.lock();
+
+            assert(pool.remaining_tasks > 0);
+            --pool.remaining_tasks;
+            if (pool.remaining_tasks == 0) {
+                pool.work_done.notify_all();
+            }
+        }
+    }
+
+    static void worker_main(ThreadPool& pool) {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        while (true) {
+            pool.work_available.wait(lock, [&pool]() {
+                return pool.stopping || pool.next_task < pool.task_count;
+            });
+
+            if (pool.stopping) {
+                return;
+            }
+
+            work(pool, lock);
+        }
+    }
+
+    ThreadPool::ThreadPool(U32 thread_count)
+        : task(nullptr)
+        , task_count(0)
+        , next_task(0)
+        , remaining_tasks(0)
+        , stopping(false)
+    {
+        assert(thread_count > 0);
+        workers.reserve(thread_count - 1);
+        for (U32 i = 1; i < thread_count; ++i) {
+            workers.emplace_back(worker_main, std::ref(*this));
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        work_available.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    U32 hardware_thread_count() {
+        return util::max(std::thread::hardware_concurrency(), 1);
+    }
+
+    U32 thread_count(const ThreadPool& pool) {
+        return static_cast<U32>(pool.workers.size()) + 1;
+    }
+
+    void run(ThreadPool& pool, U32 task_count, const std::function<void(U32)>& task) {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        assert(pool.remaining_tasks == 0);
+
+        pool.task = &task;
+        pool.task_count = task_count;
+        pool.next_task = 0;
+        pool.remaining_tasks = task_count;
+        pool.work_available.notify_all();
+
+        work(pool, lock);
+        pool.work_done.wait(lock, [&pool]() {
+            return pool.remaining_tasks == 0;
+        });
+
+        pool.task = nullptr;
+        pool.task_count = 0;
+        pool.next_task = 0;
+    }
+} // namespace thread_pool
+} // namespace tic_tac_toe
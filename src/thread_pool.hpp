@@ -0,0 +1,37 @@
+#pragma once
+
+#include "util.hpp"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tic_tac_toe {
+namespace thread_pool {
+    // fixed set of threads that run batches of indexed tasks
+    // the thread calling run works on the batch too, so a pool of n threads starts n - 1 workers
+    struct ThreadPool {
+        explicit ThreadPool(U32 thread_count);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable work_available;
+        std::condition_variable work_done;
+        const std::function<void(U32)>* task;
+        U32 task_count;
+        U32 next_task;
+        U32 remaining_tasks;
+        bool stopping;
+    };
+
+    U32 hardware_thread_count();
+    U32 thread_count(const ThreadPool& pool);
+    // runs task(i) for every i in [0, task_count) and returns once all of them have finished
+    // only one batch can run at a time
+    void run(ThreadPool& pool, U32 task_count, const std::function<void(U32)>& task);
+} // namespace thread_pool
+} // namespace tic_tac_toe
@@ -1,53 +1,143 @@
-
 #include "tree_search.hpp"
 #include "engine.hpp"
+#include "perfect_play.hpp"
 #include "util.hpp"
 #include <cassert>
+#include <type_traits>
+#include <unordered_map>
 
 namespace tic_tac_toe {
 namespace tree_search {
-    enum struct Score {
+    enum struct Score : U8 {
         Draw,
         OWins,
         XWins
     };
 
-    struct ScoreAndCoord {
-        engine::Coordinate coord;
+    struct ScoreAndCell {
+        engine::CellIndex cell;
         Score score;
     };
 
-    Score get_score(engine::Board& board);
-
-    U8 get_child_scores(engine::Board& board, ScoreAndCoord result[9]) {
-        assert(board.game_end == engine::GameEnd::None);
-        U8 count = 0;
-        for (U8 i = 0; i < 9; ++i) {
-            const engine::Coordinate coord(i);
-            if (engine::get_cell(board, coord) == engine::Cell::Empty) {
-                engine::play_move(board, coord);
-                result[count] = ScoreAndCoord{coord, get_score(board)};
-                ++count;
-                engine::undo(board);
+    template <typename Rules>
+    Score get_score(const engine::SearchState<Rules>& state);
+
+    // the rotations and reflections that map the board onto itself, symmetric positions have the same score
+    // 8 for a square board, a rectangle cannot be transposed
+    template <typename Rules>
+    static constexpr U32 symmetry_count = Rules::width == Rules::height ? 8 : 4;
+
+    // cells[s][i] is where symmetry s moves cell i
+    template <typename Rules>
+    struct Symmetries {
+        engine::CellIndex cells[8][Rules::cell_count];
+    };
+
+    template <typename Rules>
+    static constexpr Symmetries<Rules> symmetries = [] {
+        Symmetries<Rules> result{};
+        for (U32 s = 0; s < symmetry_count<Rules>; ++s) {
+            for (U32 i = 0; i < Rules::cell_count; ++i) {
+                U32 r = i / Rules::width;
+                U32 c = i % Rules::width;
+                if (s & 4) {
+                    const U32 t = r;
+                    r = c;
+                    c = t;
+                }
+                if (s & 1) {
+                    r = Rules::height - 1 - r;
+                }
+                if (s & 2) {
+                    c = Rules::width - 1 - c;
+                }
+                result.cells[s][i] = static_cast<engine::CellIndex>(r * Rules::width + c);
             }
         }
+        return result;
+    }();
+
+    // a position moved by the symmetry with the smallest zobrist hash, so every symmetric position maps to the same one
+    // O always moves first, so the pieces alone decide whose turn it is
+    template <typename Rules>
+    struct CanonicalPosition {
+        U64 hash;
+        typename Rules::Mask cells[2]; // indexed by Player
+    };
+
+    template <typename Rules>
+    static CanonicalPosition<Rules> get_canonical_position(const engine::SearchState<Rules>& state) {
+        using Mask = typename Rules::Mask;
+        U64 hashes[symmetry_count<Rules>]{};
+        Mask cells[symmetry_count<Rules>][2]{};
+        for (U8 player = 0; player < 2; ++player) {
+            for (Mask player_cells = state.cells[player]; player_cells; player_cells = engine::without_first_cell(player_cells)) {
+                const engine::CellIndex cell = engine::get_first_cell(player_cells);
+                for (U32 s = 0; s < symmetry_count<Rules>; ++s) {
+                    const engine::CellIndex symmetric_cell = symmetries<Rules>.cells[s][cell];
+                    hashes[s] ^= engine::get_zobrist_key<Rules>(static_cast<engine::Player>(player), symmetric_cell);
+                    cells[s][player] |= engine::get_cell_mask<Mask>(symmetric_cell);
+                }
+            }
+        }
+
+        U32 smallest = 0;
+        for (U32 s = 1; s < symmetry_count<Rules>; ++s) {
+            smallest = hashes[s] < hashes[smallest] ? s : smallest;
+        }
+        return CanonicalPosition<Rules>{hashes[smallest], {cells[smallest][0], cells[smallest][1]}};
+    }
+
+    // the position is kept next to its score, so two positions whose hashes collide never share a score
+    template <typename Rules>
+    struct CacheEntry {
+        typename Rules::Mask cells[2]; // indexed by Player
+        Score score;
+    };
+
+    // scores of every position solved so far, keyed by canonical hash and kept across calls
+    // tic-tac-toe has only 765 positions up to symmetry, so after the first search every query is a few lookups
+    // per thread like visited_count, so searches on different threads never share a cache
+    // a function local, gcc does not construct a thread_local variable template that needs dynamic initialisation
+    template <typename Rules>
+    static std::unordered_map<U64, CacheEntry<Rules>>& get_score_cache() {
+        thread_local std::unordered_map<U64, CacheEntry<Rules>> score_cache;
+        return score_cache;
+    }
+
+    // positions visited by the current call to generate_computer_moves, per thread so searches can run side by side
+    template <typename Rules>
+    static thread_local U64 visited_count;
+
+    template <typename Rules>
+    static engine::CellIndex get_child_scores(const engine::SearchState<Rules>& state, ScoreAndCell result[]) {
+        assert(state.game_end == engine::GameEnd::None);
+        engine::CellIndex count = 0;
+        for (typename Rules::Mask empty_cells = engine::get_empty_cells(state); empty_cells; empty_cells = engine::without_first_cell(empty_cells)) {
+            const engine::CellIndex cell = engine::get_first_cell(empty_cells);
+            engine::SearchState<Rules> child = state;
+            engine::play_move(child, cell);
+            result[count] = ScoreAndCell{cell, get_score(child)};
+            ++count;
+        }
         return count;
     }
 
-    U8 get_best_child_scores(engine::Board& board, ScoreAndCoord result[9]) {
-        const U8 count = get_child_scores(board, result);
+    template <typename Rules>
+    static engine::CellIndex get_best_child_scores(const engine::SearchState<Rules>& state, ScoreAndCell result[]) {
+        const engine::CellIndex count = get_child_scores(state, result);
 
         if (count <= 1) {
             return count;
         }
 
-        const Score win_score = board.next_turn == engine::Player::O ? Score::OWins : Score::XWins;
+        const Score win_score = state.next_turn == engine::Player::O ? Score::OWins : Score::XWins;
 
-        U8 use_count = 0;
-        for (U8 i = 0; i < count; ++i) {
+        engine::CellIndex use_count = 0;
+        for (engine::CellIndex i = 0; i < count; ++i) {
             if (result[i].score == win_score) {
                 if (i != use_count) {
-                    ScoreAndCoord tmp = result[use_count];
+                    ScoreAndCell tmp = result[use_count];
                     result[use_count] = result[i];
                     result[i] = tmp;
                 }
@@ -56,7 +146,7 @@ namespace tree_search {
         }
 
         if (use_count == 0) {
-            for (U8 i = 0; i < count; ++i) {
+            for (engine::CellIndex i = 0; i < count; ++i) {
                 if (result[i].score == Score::Draw) {
                     if (i != use_count) {
                         result[use_count] = result[i];
@@ -73,62 +163,193 @@ namespace tree_search {
         return use_count;
     }
 
-    U8 get_best_child_moves(engine::Board& board, engine::Coordinate result[9]) {
-        ScoreAndCoord scores[9];
-        const U8 count = get_best_child_scores(board, scores);
-        for (U8 i = 0; i < count; ++i) {
-            result[i] = scores[i].coord;
+    template <typename Rules>
+    static engine::CellIndex get_best_child_moves(const engine::SearchState<Rules>& state, engine::Coordinate result[]) {
+        ScoreAndCell scores[Rules::cell_count];
+        const engine::CellIndex count = get_best_child_scores(state, scores);
+        for (engine::CellIndex i = 0; i < count; ++i) {
+            result[i] = engine::get_coordinate<Rules>(scores[i].cell);
         }
         return count;
     }
 
-    ScoreAndCoord get_best_child_score(engine::Board& board) { 
-        ScoreAndCoord score[9]{};
-        const U8 count = get_best_child_scores(board, score);
-
-        if (count == 1) {
-            return score[0];
-        }
-
-        const U8 index = util::random(0, count);
-        return score[index];
+    // every best child has the same score, so there is no need to pick one at random
+    template <typename Rules>
+    static ScoreAndCell get_best_child_score(const engine::SearchState<Rules>& state) {
+        ScoreAndCell score[Rules::cell_count]{};
+        [[maybe_unused]] const engine::CellIndex count = get_best_child_scores(state, score);
+        assert(count > 0);
+        return score[0];
     }
 
-    Score get_score(engine::Board& board) {
-        if (board.game_end == engine::GameEnd::Draw) {
+    template <typename Rules>
+    Score get_score(const engine::SearchState<Rules>& state) {
+        ++visited_count<Rules>;
+        if (state.game_end == engine::GameEnd::Draw) {
             return Score::Draw;
         }
 
-        if (board.game_end == engine::GameEnd::XWin) {
-            assert(board.next_turn == engine::Player::O);
+        if (state.game_end == engine::GameEnd::XWin) {
+            assert(state.next_turn == engine::Player::O);
             return Score::XWins;
         }
 
-        if (board.game_end == engine::GameEnd::OWin) {
-            assert(board.next_turn == engine::Player::X);
+        if (state.game_end == engine::GameEnd::OWin) {
+            assert(state.next_turn == engine::Player::X);
             return Score::OWins;
         }
 
-        return get_best_child_score(board).score;
+        // a position that collides with the cached one is solved again and left out of the cache
+        const CanonicalPosition<Rules> position = get_canonical_position(state);
+        std::unordered_map<U64, CacheEntry<Rules>>& score_cache = get_score_cache<Rules>();
+        const auto cached = score_cache.find(position.hash);
+        if (cached != score_cache.end() && cached->second.cells[0] == position.cells[0] && cached->second.cells[1] == position.cells[1]) {
+            return cached->second.score;
+        }
+
+        const Score score = get_best_child_score(state).score;
+        score_cache.emplace(position.hash, CacheEntry<Rules>{{position.cells[0], position.cells[1]}, score});
+        return score;
+    }
+
+    // move ordering state of one alpha-beta search
+    template <typename Rules>
+    struct AlphaBeta {
+        U32 history[2][Rules::cell_count]; // indexed by Player and cell, grows every time the move causes a cutoff
+        typename Rules::Mask killers[Rules::cell_count + 1]; // indexed by ply, the last move that caused a cutoff there
+    };
+
+    // number of win lines through every cell, on 3x3 4 for the centre, 3 for the corners and 2 for the edges
+    template <typename Rules>
+    struct LineCounts {
+        U8 counts[Rules::cell_count];
+    };
+
+    template <typename Rules>
+    static constexpr LineCounts<Rules> line_counts = [] {
+        LineCounts<Rules> result{};
+        for (const typename Rules::Mask line : engine::win_lines<Rules>.lines) {
+            for (engine::CellIndex i = 0; i < Rules::cell_count; ++i) {
+                result.counts[i] += engine::has_cell(line, i);
+            }
+        }
+        return result;
+    }();
+
+    // killer move first, then by history, with ties going to cells on more win lines
+    template <typename Rules>
+    static engine::CellIndex order_moves(const engine::SearchState<Rules>& state, const AlphaBeta<Rules>& search, engine::CellIndex moves[]) {
+        const U32* history = search.history[static_cast<U8>(state.next_turn)];
+        U64 keys[Rules::cell_count];
+        engine::CellIndex count = 0;
+        for (typename Rules::Mask empty_cells = engine::get_empty_cells(state); empty_cells; empty_cells = engine::without_first_cell(empty_cells)) {
+            const engine::CellIndex cell = engine::get_first_cell(empty_cells);
+            const bool is_killer = engine::has_cell(search.killers[state.ply], cell);
+            const U64 key = static_cast<U64>(is_killer) << 40 | static_cast<U64>(history[cell]) << 8 | line_counts<Rules>.counts[cell];
+
+            // insertion sort, moves arrive in cell order and most keys are still equal
+            engine::CellIndex i = count;
+            for (; i > 0 && keys[i - 1] < key; --i) {
+                keys[i] = keys[i - 1];
+                moves[i] = moves[i - 1];
+            }
+            keys[i] = key;
+            moves[i] = cell;
+            ++count;
+        }
+        return count;
     }
 
-    void generate_computer_moves(engine::Board& board) {
-        if (board.game_end != engine::GameEnd::None) {
-            return;
+    // value for the player to move, 1 for a win, 0 for a draw and -1 for a loss
+    // a win is the best possible value, so with beta at most 1 the search stops at the first proven win
+    template <typename Rules>
+    static int negamax(const engine::SearchState<Rules>& state, int alpha, int beta, AlphaBeta<Rules>& search) {
+        ++visited_count<Rules>;
+        if (state.game_end != engine::GameEnd::None) {
+            // only the player who just moved can have won
+            return state.game_end == engine::GameEnd::Draw ? 0 : -1;
         }
-        
-        const U8 history_count_copy = board.history_count;
-        engine::Coordinate history_copy[9];
-        for (U8 i = 0; i < history_count_copy; ++i) {
-            history_copy[i] = board.history[i];
+
+        engine::CellIndex moves[Rules::cell_count];
+        const engine::CellIndex count = order_moves(state, search, moves);
+        int best = -2;
+        for (engine::CellIndex i = 0; i < count; ++i) {
+            engine::SearchState<Rules> child = state;
+            engine::play_move(child, moves[i]);
+            const int score = -negamax(child, -beta, -alpha, search);
+            best = score > best ? score : best;
+            alpha = best > alpha ? best : alpha;
+            if (alpha >= beta) {
+                const U32 depth = Rules::cell_count - state.ply;
+                search.history[static_cast<U8>(state.next_turn)][moves[i]] += depth * depth;
+                search.killers[state.ply] = engine::get_cell_mask<typename Rules::Mask>(moves[i]);
+                break;
+            }
+        }
+        return best;
+    }
+
+    // every root move is searched with alpha just below the best value so far, so a move that ties it gets its
+    // exact value instead of failing low, and all equally optimal moves are returned
+    template <typename Rules>
+    static engine::CellIndex get_best_child_moves_alpha_beta(const engine::SearchState<Rules>& state, engine::Coordinate result[]) {
+        AlphaBeta<Rules> search{};
+        engine::CellIndex moves[Rules::cell_count];
+        int scores[Rules::cell_count];
+        const engine::CellIndex count = order_moves(state, search, moves);
+        int best = -2;
+        for (engine::CellIndex i = 0; i < count; ++i) {
+            engine::SearchState<Rules> child = state;
+            engine::play_move(child, moves[i]);
+            scores[i] = -negamax(child, -2, -(best - 1), search);
+            best = scores[i] > best ? scores[i] : best;
+        }
+
+        engine::CellIndex result_count = 0;
+        for (engine::CellIndex i = 0; i < count; ++i) {
+            if (scores[i] == best) {
+                result[result_count] = engine::get_coordinate<Rules>(moves[i]);
+                ++result_count;
+            }
         }
+        return result_count;
+    }
 
-        board.ai_best_moves_count = get_best_child_moves(board, board.ai_best_moves);
+    // false for every Rules, but only known once Rules is, so a static_assert on it fires only where it is instantiated
+    template <typename Rules>
+    static constexpr bool dependent_false = false;
 
-        board.history_count = history_count_copy;
-        for (U8 i = 0; i < history_count_copy; ++i) {
-            board.history[i] = history_copy[i];
+    template <Mode mode, typename Rules>
+    U64 generate_computer_moves(engine::Board<Rules>& board) {
+        if (board.state.game_end != engine::GameEnd::None) {
+            return 0;
         }
+
+        visited_count<Rules> = 0;
+        if constexpr (mode == Mode::AlphaBeta) {
+            board.ai_best_moves_count = get_best_child_moves_alpha_beta(board.state, board.ai_best_moves);
+        } else if constexpr (mode == Mode::Table) {
+            if constexpr (std::is_same_v<Rules, engine::TicTacToe>) {
+                board.ai_best_moves_count = 0;
+                for (engine::TicTacToe::Mask moves = perfect_play::get_best_moves(board.state); moves; moves = engine::without_first_cell(moves)) {
+                    board.ai_best_moves[board.ai_best_moves_count] = engine::get_coordinate<Rules>(engine::get_first_cell(moves));
+                    ++board.ai_best_moves_count;
+                }
+            } else {
+                static_assert(dependent_false<Rules>, "the perfect play table only exists for tic-tac-toe");
+            }
+        } else {
+            board.ai_best_moves_count = get_best_child_moves(board.state, board.ai_best_moves);
+        }
+        return visited_count<Rules>;
     }
+
+    template U64 generate_computer_moves<Mode::Memoized>(engine::Board<engine::TicTacToe>& board);
+    template U64 generate_computer_moves<Mode::Memoized>(engine::Board<engine::ConnectFive>& board);
+    template U64 generate_computer_moves<Mode::Memoized>(engine::Board<engine::Gomoku>& board);
+    template U64 generate_computer_moves<Mode::AlphaBeta>(engine::Board<engine::TicTacToe>& board);
+    template U64 generate_computer_moves<Mode::AlphaBeta>(engine::Board<engine::ConnectFive>& board);
+    template U64 generate_computer_moves<Mode::AlphaBeta>(engine::Board<engine::Gomoku>& board);
+    template U64 generate_computer_moves<Mode::Table>(engine::Board<engine::TicTacToe>& board);
 } // namespace tree_search
 } // namespace tic_tac_toe
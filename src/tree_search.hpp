@@ -5,6 +5,17 @@
 
 namespace tic_tac_toe {
 namespace tree_search {
-    void generate_computer_moves(engine::Board& board);
+    enum class Mode : U8 {
+        Memoized, // exhaustive, every position is solved once and cached across the calls made on the same thread
+        AlphaBeta, // negamax with move ordering, nothing is cached
+        Table // lookup in the perfect play table solved at compile time, no search at all
+    };
+
+    // instantiated for engine::TicTacToe, engine::ConnectFive and engine::Gomoku
+    // only small boards can be solved exhaustively, and Mode::Table only exists for tic-tac-toe,
+    // so the mode is a template argument and asking any other board for the table does not compile
+    // returns the number of positions the search visited, cache hits included
+    template <Mode mode = Mode::Memoized, typename Rules>
+    U64 generate_computer_moves(engine::Board<Rules>& board);
 } // namespace tree_search
 } // namespace tic_tac_toe
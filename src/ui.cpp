@@ -4,18 +4,30 @@
 #include "util.hpp"
 #include "mcts.hpp"
 #include "tree_search.hpp"
+#include "thread_pool.hpp"
 #include <cassert>
 #include <raylib.h>
 
 #define SEARCH_TYPE_MCTS 0
 #define SEARCH_TYPE_TREE 1
+#define SEARCH_TYPE_ALPHA_BETA 2
+#define SEARCH_TYPE_TABLE 3
 #define SEARCH_TYPE SEARCH_TYPE_MCTS
-static_assert(SEARCH_TYPE == SEARCH_TYPE_MCTS || SEARCH_TYPE == SEARCH_TYPE_TREE);
+static_assert(SEARCH_TYPE == SEARCH_TYPE_MCTS || SEARCH_TYPE == SEARCH_TYPE_TREE || SEARCH_TYPE == SEARCH_TYPE_ALPHA_BETA || SEARCH_TYPE == SEARCH_TYPE_TABLE);
 
 namespace tic_tac_toe {
 namespace ui {
+    // the engine plays any board, the ui lays out and draws this one
+    using Rules = engine::TicTacToe;
+
     struct State {
-        engine::Board board;
+        engine::Board<Rules> board;
+        mcts::Search<Rules> search; // keeps the tree of the last search, so searching the next position is mostly done
+        mcts::AsyncSearch<Rules> async_search; // runs on search, so it is declared after it and destroyed first
+        mcts::Progress<Rules> progress;
+        mcts::Stats<Rules> stats; // of the last search that finished
+        bool show_stats;
+        util::Rng rng;
         U32 board_top_left_x;
         U32 board_top_left_y;
     };
@@ -25,8 +37,9 @@ namespace ui {
     static constexpr U32 smallest_dimension = (window_width < window_height ? window_width : window_height);
     static constexpr U32 margin = smallest_dimension * 0.05;
     static constexpr U32 board_size = smallest_dimension - margin * 2;
-    static constexpr U32 cell_margin = (board_size / 3) * 0.05;
-    static constexpr U32 cell_size = (board_size - cell_margin * 2) / 3;
+    static constexpr U32 board_cells = Rules::width > Rules::height ? Rules::width : Rules::height;
+    static constexpr U32 cell_margin = (board_size / board_cells) * 0.05;
+    static constexpr U32 cell_size = (board_size - cell_margin * (board_cells - 1)) / board_cells;
     static const Color cell_color{120, 140, 170, 255};
     static const Color background_color{200, 215, 230, 255};
     static const Color piece_color = background_color;
@@ -82,7 +95,7 @@ namespace ui {
 
         if (get_cell(state.board, coord) == engine::Cell::Empty) {
             bool is_ai_best_move = false;
-            for (U8 i = 0; i < state.board.ai_best_moves_count; ++i) {
+            for (engine::CellIndex i = 0; i < state.board.ai_best_moves_count; ++i) {
                 if (state.board.ai_best_moves[i].r == coord.r && state.board.ai_best_moves[i].c == coord.c) {
                     is_ai_best_move = true;
                     break;
@@ -91,7 +104,7 @@ namespace ui {
 
             if (is_ai_best_move) {
                 const Color color{piece_color.r, piece_color.g, piece_color.b, 65};
-                if (state.board.next_turn == engine::Player::O) {
+                if (state.board.state.next_turn == engine::Player::O) {
                     draw_o(state, coord, color);
                 } else {
                     draw_x(state, coord, color);
@@ -99,25 +112,22 @@ namespace ui {
             }
         } else {
             Color color = piece_color;
-            if (state.board.game_end == engine::GameEnd::OWin || state.board.game_end == engine::GameEnd::XWin) {
-                for (U32 i = 0; i < state.board.win_cell_count; ++i) {
-                    if (coord.r == state.board.win_cell[i].r && coord.c == state.board.win_cell[i].c) {
-                        color = win_color;
-                        break;
-                    }
+            if (state.board.state.game_end == engine::GameEnd::OWin || state.board.state.game_end == engine::GameEnd::XWin) {
+                if (engine::has_cell(engine::get_winning_cells(state.board), engine::index<Rules>(coord))) {
+                    color = win_color;
                 }
-            } else if (state.board.game_end == engine::GameEnd::Draw) {
+            } else if (state.board.state.game_end == engine::GameEnd::Draw) {
                 color = draw_color;
             }
 
-            draw_piece(state, state.board.cell[coord.r][coord.c], coord, color);
+            draw_piece(state, get_cell(state.board, coord), coord, color);
         }
     }
 
     void draw_next_turn_player(const State& state) {
         const float x_margin = state.board_top_left_x * 0.1f;
         const float size = state.board_top_left_x * 0.8;
-        if (state.board.next_turn == engine::Player::O) {
+        if (state.board.state.next_turn == engine::Player::O) {
             draw_o(x_margin, margin, size, cell_color);
         } else {
             draw_x(x_margin, margin, size, cell_color);
@@ -128,22 +138,22 @@ namespace ui {
         const float margin = state.board_top_left_x * 0.1f;
         const float size = state.board_top_left_x * 0.8;
         const float y = margin + size + margin * 3;
-        if (state.board.game_end == engine::GameEnd::OWin) {
+        if (state.board.state.game_end == engine::GameEnd::OWin) {
             draw_o(margin, y, size, win_color);
-        } else if (state.board.game_end == engine::GameEnd::XWin) {
+        } else if (state.board.state.game_end == engine::GameEnd::XWin) {
             draw_x(margin, y, size, win_color);
-        } else if (state.board.game_end == engine::GameEnd::Draw) {
+        } else if (state.board.state.game_end == engine::GameEnd::Draw) {
             draw_o(margin, y, size, draw_color);
             draw_x(margin, y, size, draw_color);
         }
     }
 
-    void draw_history(const engine::Cell board[3][3], engine::Coordinate coord, float x, float y, float size, Color cell_color) {
-        const U32 margin = util::max((size / 3.0f) * 0.05f, 1);
-        const U32 cell_size = (size - margin * 2.0f) / 3.0f;
+    void draw_history(const engine::Cell board[Rules::height][Rules::width], engine::Coordinate coord, float x, float y, float size, Color cell_color) {
+        const U32 margin = util::max((size / board_cells) * 0.05f, 1);
+        const U32 cell_size = (size - margin * (board_cells - 1.0f)) / board_cells;
         const Color not_most_recent_move_cell_color{cell_color.r, cell_color.g, cell_color.b, 100};
-        for (U32 r = 0; r < 3; ++r) {
-            for (U32 c = 0; c < 3; ++c) {
+        for (U32 r = 0; r < Rules::height; ++r) {
+            for (U32 c = 0; c < Rules::width; ++c) {
                 const float cell_x = x + c * (cell_size + margin);
                 const float cell_y = y + r * (cell_size + margin);
                 const Color color = coord.r == r && coord.c == c ? cell_color : not_most_recent_move_cell_color;
@@ -163,27 +173,103 @@ namespace ui {
         const U32 y = margin;
         const U32 height = window_height - margin * 2;
         const U32 item_margin = height * 0.012;
-        const U32 item_height = (height - item_margin * 8) / 9;
+        const U32 item_height = (height - item_margin * (Rules::cell_count - 1)) / Rules::cell_count;
         const U32 min_x_margin = state.board_top_left_x * 0.05;
         const U32 max_width = state.board_top_left_x - min_x_margin * 2;
         const U32 item_width = util::min(max_width, item_height);
         const U32 x_margin = (state.board_top_left_x - item_width) / 2;
         const U32 x = window_width - state.board_top_left_x + x_margin;
-        engine::Cell board[3][3]{};
+        engine::Cell board[Rules::height][Rules::width]{};
         engine::Player player = engine::Player::O;
         for (U32 i = 0; i < state.board.history_count; ++i) {
             const engine::Coordinate coord = state.board.history[i];
             board[coord.r][coord.c] = engine::get_cell(player);
             player = engine::other(player);
             const U32 item_y = y + i * (item_height + item_margin);
-            const Color color = i == (state.board.history_next_index - 1) ? Color{170, 140, 120, 255} : cell_color;
+            const Color color = i == (state.board.state.ply - 1) ? Color{170, 140, 120, 255} : cell_color;
             draw_history(board, coord, x, item_y, item_width, color);
         }
     }
 
+    // while the engine thinks, every move it weighs is drawn faintly, more visits drawing it stronger, with its visit count
+    void draw_search_progress(const State& state) {
+        U32 most_visits = 1;
+        for (engine::CellIndex i = 0; i < state.progress.move_count; ++i) {
+            most_visits = util::max(most_visits, state.progress.visit_counts[i]);
+        }
+
+        for (engine::CellIndex i = 0; i < state.progress.move_count; ++i) {
+            const engine::Coordinate coord = engine::get_coordinate<Rules>(state.progress.cells[i]);
+            const U32 visits = state.progress.visit_counts[i];
+            const Color color{piece_color.r, piece_color.g, piece_color.b, static_cast<unsigned char>(15 + 80 * static_cast<U64>(visits) / most_visits)};
+            if (state.board.state.next_turn == engine::Player::O) {
+                draw_o(state, coord, color);
+            } else {
+                draw_x(state, coord, color);
+            }
+
+            const Vector2 pos = get_cell_screen_pos(state, coord);
+            DrawText(TextFormat("%u", visits), pos.x + cell_size * 0.05f, pos.y + cell_size * 0.05f, cell_size / 8, piece_color);
+        }
+    }
+
+    // debug overlay, toggled with S, the numbers of the last search down the left and while its moves are still shown,
+    // the share of the root visits every move got
+    void draw_search_stats(const State& state) {
+        const mcts::Stats<Rules>& stats = state.stats;
+        if (stats.iteration_count == 0) {
+            return;
+        }
+
+        if (state.board.ai_best_moves_count > 0) {
+            U64 total_visits = 0;
+            for (engine::CellIndex i = 0; i < stats.move_count; ++i) {
+                total_visits += stats.visit_counts[i];
+            }
+
+            for (engine::CellIndex i = 0; i < stats.move_count; ++i) {
+                const Vector2 pos = get_cell_screen_pos(state, engine::get_coordinate<Rules>(stats.cells[i]));
+                const float share = total_visits > 0 ? 100.0f * stats.visit_counts[i] / total_visits : 0.0f;
+                DrawText(TextFormat("%.1f%%", share), pos.x + cell_size * 0.05f, pos.y + cell_size * 0.85f, cell_size / 8, piece_color);
+            }
+        }
+
+        // TextFormat only keeps its last few results, so every line is drawn as soon as it is formatted
+        const U32 line_count = (MCTS_STATS ? 11 : 5) + (stats.proof != mcts::Proof::None ? 1 : 0) + (stats.edges_exhausted ? 1 : 0);
+        const U32 font_size = 10;
+        const U32 line_height = font_size + 2;
+        const U32 x = state.board_top_left_x * 0.05;
+        U32 y = window_height - margin - line_count * line_height;
+        const auto draw_line = [x, &y](const char* text) {
+            DrawText(text, x, y, font_size, cell_color);
+            y += line_height;
+        };
+
+        draw_line(TextFormat("%.1f ms", stats.seconds * 1000.0));
+        draw_line(TextFormat("%u iters", stats.iteration_count));
+        draw_line(TextFormat("%.0f k iters/s", stats.seconds > 0.0 ? stats.iteration_count / stats.seconds / 1000.0 : 0.0));
+        draw_line(TextFormat("%u nodes", stats.node_count));
+        draw_line(TextFormat("%u reused + %u new visits", stats.reused_visit_count, stats.new_visit_count));
+        if (stats.edges_exhausted) {
+            draw_line("edges exhausted");
+        }
+        // for the computer, which was to move when it searched
+        if (stats.proof != mcts::Proof::None) {
+            draw_line(stats.proof == mcts::Proof::Win ? "proven win" : stats.proof == mcts::Proof::Loss ? "proven loss" : "proven draw");
+        }
+#if MCTS_STATS
+        draw_line(TextFormat("depth %u", stats.max_depth));
+        draw_line(TextFormat("rollout %.1f", stats.rollout_count > 0 ? static_cast<double>(stats.rollout_move_count) / stats.rollout_count : 0.0));
+        draw_line(TextFormat("select %.1f ms", stats.select_seconds * 1000.0));
+        draw_line(TextFormat("expand %.1f ms", stats.expand_seconds * 1000.0));
+        draw_line(TextFormat("simulate %.1f ms", stats.simulate_seconds * 1000.0));
+        draw_line(TextFormat("backprop %.1f ms", stats.backprop_seconds * 1000.0));
+#endif
+    }
+
     engine::Coordinate get_cell_for_screen_pos(const State& state, Vector2 pos) {
-        for (engine::Coordinate::Type r = 0; r < 3; ++r) {
-            for (engine::Coordinate::Type c = 0; c < 3; ++c) {
+        for (engine::Coordinate::Type r = 0; r < Rules::height; ++r) {
+            for (engine::Coordinate::Type c = 0; c < Rules::width; ++c) {
                 const Vector2 cell_pos = get_cell_screen_pos(state, engine::Coordinate(r, c));
                 if (pos.x > cell_pos.x && pos.x < cell_pos.x + cell_size && pos.y > cell_pos.y && pos.y < cell_pos.y + cell_size) {
                     return engine::Coordinate(r, c);
@@ -195,18 +281,32 @@ namespace ui {
     }
 
     void run() {
-        srand(420);
         State state{};
+        state.rng = util::make_rng(420);
         state.board_top_left_x = (window_width - board_size) / 2;
         state.board_top_left_y = (window_height - board_size) / 2;
 
         init();
 
         while (!WindowShouldClose()) {
+            // every change to the board cancels the search first, so a finished search is of the board on screen
+            if (mcts::poll(state.async_search, state.progress)) {
+                state.stats = state.async_search.stats;
+                state.board.ai_best_moves_count = state.async_search.board.ai_best_moves_count;
+                for (engine::CellIndex i = 0; i < state.board.ai_best_moves_count; ++i) {
+                    state.board.ai_best_moves[i] = state.async_search.board.ai_best_moves[i];
+                }
+            }
+
+            if (IsKeyPressed(KEY_S)) {
+                state.show_stats = !state.show_stats;
+            }
+
             if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
                 const Vector2 pos = GetMousePosition();
                 const engine::Coordinate coord = get_cell_for_screen_pos(state, pos);
-                if (is_valid(coord)) {
+                if (is_valid(coord) && get_cell(state.board, coord) == engine::Cell::Empty) {
+                    mcts::cancel(state.async_search);
                     play_move(state.board, coord);
                 }
             }
@@ -214,22 +314,33 @@ namespace ui {
             if (IsKeyPressed(KEY_LEFT)) {
                 if (!IsKeyPressed(KEY_RIGHT)) {
                     if (can_undo(state.board)) {
+                        mcts::cancel(state.async_search);
                         undo(state.board);
                     }
                 }
             } else if (IsKeyPressed(KEY_RIGHT)) {
                 if (can_redo(state.board)) {
+                    mcts::cancel(state.async_search);
                     redo(state.board);
                 }
             } else if (IsKeyPressed(KEY_DOWN)) {
                 if (state.board.ai_best_moves_count == 0) {
 #if SEARCH_TYPE == SEARCH_TYPE_MCTS
-                    mcts::generate_computer_moves(state.board);
+                    if (!mcts::is_running(state.async_search)) {
+                        mcts::Config config;
+                        // the ui thread keeps a core to itself, so frames keep coming while the engine thinks
+                        config.thread_count = util::max(thread_pool::hardware_thread_count() - 1, 1);
+                        mcts::start(state.async_search, state.search, state.board, state.rng, config);
+                    }
 #elif SEARCH_TYPE == SEARCH_TYPE_TREE
                     tree_search::generate_computer_moves(state.board);
+#elif SEARCH_TYPE == SEARCH_TYPE_ALPHA_BETA
+                    tree_search::generate_computer_moves<tree_search::Mode::AlphaBeta>(state.board);
+#elif SEARCH_TYPE == SEARCH_TYPE_TABLE
+                    tree_search::generate_computer_moves<tree_search::Mode::Table>(state.board);
 #endif
                 } else {
-                    play_computer_move(state.board);
+                    play_computer_move(state.board, state.rng);
                 }
             }
 
@@ -237,15 +348,22 @@ namespace ui {
             {
                 ClearBackground(background_color);
 
-                for (engine::Coordinate::Type r = 0; r < 3; ++r) {
-                    for (engine::Coordinate::Type c = 0; c < 3; ++c) {
+                for (engine::Coordinate::Type r = 0; r < Rules::height; ++r) {
+                    for (engine::Coordinate::Type c = 0; c < Rules::width; ++c) {
                         draw_cell(state, engine::Coordinate(r, c));
                     }
                 }
 
+                if (mcts::is_running(state.async_search)) {
+                    draw_search_progress(state);
+                }
+
                 draw_next_turn_player(state);
                 draw_game_end(state);
                 draw_history(state);
+                if (state.show_stats) {
+                    draw_search_stats(state);
+                }
             }
             EndDrawing();
         }
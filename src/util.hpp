@@ -23,11 +23,66 @@ namespace util {
         return a > b ? a : b;
     }
 
-    inline U8 random(U8 from, U8 till) {
-        const U8 result = (static_cast<double>(rand()) / static_cast<double>(RAND_MAX)) * (till - from) + from;
-        assert(result >= from);
-        assert(result < till);
+    // xoshiro128** generator, every thread of a search owns one so random state is never shared
+    struct Rng {
+        U32 state[4];
+    };
+
+    inline U32 rotate_left(U32 x, int k) {
+        return (x << k) | (x >> (32 - k));
+    }
+
+    // advances seed and returns a well mixed 64 bit value, usable at compile time
+    constexpr U64 splitmix64(U64& seed) {
+        seed += 0x9E3779B97F4A7C15ull;
+        U64 z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // splitmix64 spreads the seed over the whole state, which must not be all zero
+    inline Rng make_rng(U64 seed) {
+        Rng rng;
+        for (U32 i = 0; i < 4; i += 2) {
+            const U64 z = splitmix64(seed);
+            rng.state[i] = static_cast<U32>(z);
+            rng.state[i + 1] = static_cast<U32>(z >> 32);
+        }
+        return rng;
+    }
+
+    inline U32 next(Rng& rng) {
+        U32* s = rng.state;
+        const U32 result = rotate_left(s[1] * 5, 7) * 9;
+        const U32 t = s[1] << 9;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotate_left(s[3], 11);
         return result;
     }
+
+    inline U64 next_u64(Rng& rng) {
+        const U64 high = next(rng);
+        return (high << 32) | next(rng);
+    }
+
+    // uniform in [0, bound) without floating point or modulo bias (Lemire's multiply and reject)
+    inline U32 random_below(Rng& rng, U32 bound) {
+        assert(bound > 0);
+        U64 product = static_cast<U64>(next(rng)) * bound;
+        U32 low = static_cast<U32>(product);
+        if (low < bound) {
+            const U32 threshold = (0u - bound) % bound;
+            while (low < threshold) {
+                product = static_cast<U64>(next(rng)) * bound;
+                low = static_cast<U32>(product);
+            }
+        }
+        return static_cast<U32>(product >> 32);
+    }
 } // namespace util
 } // namespace tic_tac_toe